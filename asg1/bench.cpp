@@ -0,0 +1,312 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 15
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "inode.h"
+#include "util.h"
+
+//
+// ybench -
+//    Builds a synthetic tree and runs a mix of commands against it
+//    in this process, through the same command table as yshell,
+//    timing each command.  Output is thrown away, so the times are
+//    those of the tree and not of a terminal.
+//
+
+//
+// options -
+//    The shape of the tree:  how deep it is, how many directories
+//    and files each directory has, and the mean number of words in
+//    a file, drawn from a geometric distribution and a vocabulary
+//    of the given size.  Then the mix of commands, how many to run,
+//    and the random seed.
+//
+
+struct options {
+   size_t depth {4};
+   size_t fanout {6};
+   size_t files {8};
+   double words {8};
+   size_t vocabulary {1000};
+   string mix {"lookup"};
+   size_t count {100000};
+   unsigned seed {1};
+};
+
+options scan_options (int argc, char** argv) {
+   options opts;
+   opterr = 0;
+   for (;;) {
+      int option = getopt (argc, argv, "@:d:f:F:w:v:m:n:r:");
+      if (option == EOF) break;
+      switch (option) {
+         case '@': debugflags::setflags (optarg); break;
+         case 'd': opts.depth = strtoul (optarg, nullptr, 10); break;
+         case 'f': opts.fanout = strtoul (optarg, nullptr, 10); break;
+         case 'F': opts.files = strtoul (optarg, nullptr, 10); break;
+         case 'w': opts.words = strtod (optarg, nullptr); break;
+         case 'v': opts.vocabulary = strtoul (optarg, nullptr, 10);
+                   break;
+         case 'm': opts.mix = optarg; break;
+         case 'n': opts.count = strtoul (optarg, nullptr, 10); break;
+         case 'r': opts.seed = strtoul (optarg, nullptr, 10); break;
+         default:
+            complain() << "-" << (char) option << ": invalid option"
+                       << endl;
+            break;
+      }
+   }
+   if (optind < argc)
+      complain() << "operands not permitted" << endl;
+   if (opts.words < 1) opts.words = 1;
+   if (opts.vocabulary < 1) opts.vocabulary = 1;
+   return opts;
+}
+
+//
+// null_buffer -
+//    A streambuf that discards everything written to it.
+//
+
+class null_buffer: public streambuf {
+   protected:
+      int_type overflow (int_type ch) override {
+         return traits_type::not_eof (ch);
+      }
+      streamsize xsputn (const char*, streamsize count) override {
+         return count;
+      }
+};
+
+//
+// workload -
+//    Makes the command lines, keeping track of the directories and
+//    files that exist so that every command names real ones.  The
+//    directories made by the mutation mix are only ever made in
+//    the original tree, so that removing one removes no other, and
+//    the files made in them are left for rmr alone.
+//
+
+class workload {
+   private:
+      const options& opts;
+      mt19937 random;
+      vector<string> dirs;
+      vector<string> files;
+      vector<string> made_dirs;
+      size_t tree_dirs {0};
+      size_t serial {0};
+      string join (const string& dir, const string& name) const {
+         return dir == "/" ? "/" + name : dir + "/" + name;
+      }
+      size_t below (size_t size) {
+         return uniform_int_distribution<size_t> (0, size - 1)
+                (random);
+      }
+      string sentence();
+      string fresh_file();
+      string lookup();
+      string mutate();
+      string listing();
+   public:
+      workload (const options& opts_): opts (opts_),
+                random (opts_.seed) {}
+      vector<string> tree();
+      string next();
+      size_t dir_count() const { return dirs.size(); }
+      size_t file_count() const { return files.size(); }
+};
+
+string workload::sentence() {
+   geometric_distribution<size_t> length (1 / opts.words);
+   size_t count = length (random) + 1;
+   string words;
+   for (size_t i = 0; i < count; ++i) {
+      words += " w";
+      words += to_string (below (opts.vocabulary));
+   }
+   return words;
+}
+
+string workload::fresh_file() {
+   size_t dir = below (dirs.size());
+   string path = join (dirs[dir], "n" + to_string (serial++));
+   if (dir < tree_dirs) files.push_back (path);
+   return "make " + path + sentence();
+}
+
+// Level by level, so that each directory is made before its own.
+vector<string> workload::tree() {
+   vector<string> lines;
+   dirs.push_back ("/");
+   size_t first = 0;
+   for (size_t level = 0; level < opts.depth; ++level) {
+      size_t last = dirs.size();
+      for (size_t dir = first; dir < last; ++dir) {
+         for (size_t i = 0; i < opts.fanout; ++i) {
+            string path = join (dirs[dir], "d" + to_string (i));
+            lines.push_back ("mkdir " + path);
+            dirs.push_back (path);
+         }
+      }
+      first = last;
+   }
+   for (const string& dir: dirs) {
+      for (size_t i = 0; i < opts.files; ++i) {
+         string path = join (dir, "f" + to_string (i));
+         lines.push_back ("make " + path + sentence());
+         files.push_back (path);
+      }
+   }
+   tree_dirs = dirs.size();
+   return lines;
+}
+
+string workload::lookup() {
+   size_t kind = below (100);
+   if (kind < 55 and not files.empty())
+      return "cat " + files[below (files.size())];
+   if (kind < 75) return "ls " + dirs[below (dirs.size())];
+   if (kind < 90) return "cd " + dirs[below (dirs.size())];
+   return "pwd";
+}
+
+string workload::mutate() {
+   size_t kind = below (100);
+   if (kind < 35 or files.empty()) return fresh_file();
+   if (kind < 55)
+      return "make " + files[below (files.size())] + sentence();
+   if (kind < 75) {
+      string path = join (dirs[below (tree_dirs)],
+                          "m" + to_string (serial++));
+      dirs.push_back (path);
+      made_dirs.push_back (path);
+      return "mkdir " + path;
+   }
+   if (kind < 90 or made_dirs.empty()) {
+      size_t file = below (files.size());
+      string path = files[file];
+      files[file] = files.back();
+      files.pop_back();
+      return "rm " + path;
+   }
+   size_t made = below (made_dirs.size());
+   string path = made_dirs[made];
+   made_dirs[made] = made_dirs.back();
+   made_dirs.pop_back();
+   dirs.erase (find (dirs.begin() + tree_dirs, dirs.end(), path));
+   return "rmr " + path;
+}
+
+string workload::listing() {
+   size_t kind = below (100);
+   if (kind < 70) return "lsr " + dirs[below (dirs.size())];
+   if (kind < 90) return "du " + dirs[below (dirs.size())];
+   return "cat " + files[below (files.size())];
+}
+
+string workload::next() {
+   if (opts.mix == "lookup") return lookup();
+   if (opts.mix == "mutate") return mutate();
+   return listing();
+}
+
+//
+// run -
+//    Runs one command line, returning false if it failed.
+//
+
+bool run (const commands& cmdmap, inode_state& state,
+          const string& line, spanvec& words) {
+   try {
+      split_spans (line, " \t", words);
+      cmdmap.at (words.at(0)) (state, words);
+   }catch (yshell_exn&) {
+      return false;
+   }
+   return true;
+}
+
+//
+// percentile -
+//    The latency below which the given fraction of commands ran,
+//    from latencies already sorted.
+//
+
+double percentile (const vector<double>& sorted, double fraction) {
+   if (sorted.empty()) return 0;
+   size_t index = size_t (fraction * (sorted.size() - 1) + 0.5);
+   return sorted[index];
+}
+
+int main (int argc, char** argv) {
+   execname (argv[0]);
+   options opts = scan_options (argc, argv);
+   if (opts.mix != "lookup" and opts.mix != "mutate"
+       and opts.mix != "lsr") {
+      complain() << opts.mix << ": mix must be lookup, mutate or lsr"
+                 << endl;
+      return exit_status::get();
+   }
+   commands cmdmap;
+   inode_state state;
+   null_buffer discard;
+   ostream nowhere (&discard);
+   state.set_output (nowhere);
+   workload load (opts);
+   spanvec words;
+   for (const string& line: load.tree())
+      run (cmdmap, state, line, words);
+   size_t tree_dirs = load.dir_count();
+   size_t tree_files = load.file_count();
+
+   vector<double> latencies;
+   latencies.reserve (opts.count);
+   size_t failed = 0;
+   double total = 0;
+   for (size_t i = 0; i < opts.count; ++i) {
+      string line = load.next();
+      auto start = chrono::steady_clock::now();
+      if (not run (cmdmap, state, line, words)) ++failed;
+      chrono::duration<double, micro> took
+            = chrono::steady_clock::now() - start;
+      latencies.push_back (took.count());
+      total += took.count();
+   }
+   sort (latencies.begin(), latencies.end());
+   rusage usage;
+   getrusage (RUSAGE_SELF, &usage);
+
+   cout << execname() << ": tree of " << tree_dirs
+        << " directories and " << tree_files << " files, mix "
+        << opts.mix << endl;
+   cout << execname() << ": " << opts.count << " commands ("
+        << failed << " failed) in " << total / 1e6 << " seconds";
+   if (total > 0)
+      cout << ", " << size_t (opts.count / (total / 1e6))
+           << " commands/sec";
+   cout << endl;
+   cout << execname() << ": latency p50 " << percentile (latencies, 0.5)
+        << " us, p99 " << percentile (latencies, 0.99) << " us, max "
+        << (latencies.empty() ? 0 : latencies.back()) << " us" << endl;
+   cout << execname() << ": peak RSS " << usage.ru_maxrss << " KB"
+        << endl;
+   // As yshell does, leave the tree to the system.
+   exit (exit_status::get());
+}
+
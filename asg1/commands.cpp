@@ -3,81 +3,148 @@
 // ID:      1253060
 // Date:    2015 Jan 18
 
+#include <cstring>
+#include <stdexcept>
+
 #include "commands.h"
 #include "debug.h"
 
-commands::commands(): map ({
-        {"cat"   , fn_cat   },
-        {"cd"    , fn_cd    },
-        {"echo"  , fn_echo  },
-        {"exit"  , fn_exit  },
-        {"ls"    , fn_ls    },
-        {"lsr"   , fn_lsr   },
-        {"make"  , fn_make  },
-        {"mkdir" , fn_mkdir },
-        {"prompt", fn_prompt},
-        {"pwd"   , fn_pwd   },
-        {"rm"    , fn_rm    },
-        {"rmr"   , fn_rmr    },
-        }){}
-
-command_fn commands::at (const string& cmd) {
-    // Note: value_type is pair<const key_type, mapped_type>
-    // So: iterator->first is key_type (string)
-    // So: iterator->second is mapped_type (command_fn)
-    command_map::const_iterator result = map.find (cmd);
-    if (result == map.end()) {
-        throw yshell_exn (cmd + ": no such function");
+const commands::entry commands::table[] = {
+        {"cat"     , fn_cat     },
+        {"cd"      , fn_cd      },
+        {"du"      , fn_du      },
+        {"echo"    , fn_echo    },
+        {"exit"    , fn_exit    },
+        {"find"    , fn_find    },
+        {"grep"    , fn_grep    },
+        {"import"  , fn_import  },
+        {"ls"      , fn_ls      },
+        {"load"    , fn_load    },
+        {"lsr"     , fn_lsr     },
+        {"make"    , fn_make    },
+        {"mkdir"   , fn_mkdir   },
+        {"prompt"  , fn_prompt  },
+        {"pwd"     , fn_pwd     },
+        {"restore" , fn_restore },
+        {"rm"      , fn_rm      },
+        {"rmr"     , fn_rmr     },
+        {"save"    , fn_save    },
+        {"snapshot", fn_snapshot},
+        {"stats"   , fn_stats   },
+};
+
+// FNV-1a.
+uint64_t commands::hash (const char* name, size_t length) {
+    uint64_t value = 0xcbf29ce484222325;
+    for (size_t i = 0; i < length; ++i)
+        value = (value ^ static_cast<unsigned char> (name[i]))
+              * 0x100000001b3;
+    return value;
+}
+
+// Tries odd multipliers for a table at most half full, and then
+// for ever larger tables, until every command lands in its own
+// slot.  With a few dozen commands the first few tries succeed.
+commands::commands() {
+    constexpr int MAX_BITS = 16;
+    constexpr int TRIES = 1000;
+    size_t count = sizeof table / sizeof table[0];
+    int bits = 1;
+    while ((size_t (1) << bits) < count * 2) ++bits;
+    for (; bits <= MAX_BITS; ++bits) {
+        shift = 64 - bits;
+        multiplier = 0x9e3779b97f4a7c15;
+        for (int tries = 0; tries < TRIES; ++tries, multiplier += 2) {
+            slots.assign (size_t (1) << bits,
+                          slot {nullptr, 0, nullptr});
+            bool perfect = true;
+            for (const entry& command: table) {
+                size_t length = strlen (command.name);
+                slot& place = slots[slot_of (command.name, length)];
+                if (place.name != nullptr) {
+                    perfect = false;
+                    break;
+                }
+                place = slot {command.name, length, command.fn};
+            }
+            if (perfect) {
+                DEBUGF ('c', count << " commands in " << slots.size()
+                        << " slots, multiplier " << multiplier);
+                return;
+            }
+        }
+    }
+    throw logic_error ("commands: no perfect hash for the table");
+}
+
+command_fn commands::at (const word_span& cmd) const {
+    const slot& place = slots[slot_of (cmd.data, cmd.size)];
+    if (place.name == nullptr || place.length != cmd.size
+        || memcmp (place.name, cmd.data, cmd.size) != 0) {
+        throw yshell_exn (cmd.str() + ": no such function");
     }
-    return result->second;
+    return place.fn;
 }
 
-void fn_cat (inode_state& state, const wordvec& words){
+void fn_cat (inode_state& state, const spanvec& words){
     if (words.size() < 2) {
         throw yshell_exn ("cat: must specify file"); 
     }
     for (size_t i = 1; i < words.size(); i++) {
-        state.cat(words.at(i), cout);
+        state.cat(words.at(i).str(), state.out());
     }
+    flush_terminal(state.out());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_cd (inode_state& state, const wordvec& words){
+void fn_cd (inode_state& state, const spanvec& words){
     if (words.size() == 1)
         state.cd();
     else if (words.size() == 2)
-        state.cd(words.at(1));
+        state.cd(words.at(1).str());
     else
         throw yshell_exn ("cd: only one operand may be given");
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_echo (inode_state& state, const wordvec& words){
+void fn_du (inode_state& state, const spanvec& words){
+    if (words.size() == 1)
+        state.du(".", state.out());
+    else
+        for (size_t i = 1; i < words.size(); i++)
+            state.du(words.at(i).str(), state.out());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
-    wordvec args(words.begin() + 1, words.end());
-    cout << args << endl; 
 }
 
-void fn_exit (inode_state& state, const wordvec& words){
+void fn_echo (inode_state& state, const spanvec& words){
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+    for (size_t i = 1; i < words.size(); i++) {
+        if (i > 1) state.out() << ' ';
+        state.out() << words[i];
+    }
+    state.out() << endl;
+}
+
+void fn_exit (inode_state& state, const spanvec& words){
     int x;
-    state.terminate();
     if (words.size() == 2) {
         try {
-            x = stoi(words.at(1));
+            x = stoi(words.at(1).str());
             exit_status::set(x);
         }
         catch (std::invalid_argument& e){
-            throw yshell_exn("exit: " + words.at(1)
+            throw yshell_exn("exit: " + words.at(1).str()
                                   + ": exit status must be numeric");
         }
         catch (std::out_of_range& e){
-            throw yshell_exn("exit: " + words.at(1)
+            throw yshell_exn("exit: " + words.at(1).str()
                                   + ": exit status out of range");
         } catch (...) {
-            throw yshell_exn("exit: " + words.at(1)
+            throw yshell_exn("exit: " + words.at(1).str()
                                   + ": invalid exit status");
         }
     } else if (words.size() > 2) {
@@ -85,76 +152,146 @@ void fn_exit (inode_state& state, const wordvec& words){
     } 
     DEBUGF ('c', state);
     DEBUGF ('c', words);
+    state.terminate();
     throw ysh_exit_exn();
 }
 
-void fn_ls (inode_state& state, const wordvec& words){
+void fn_find (inode_state& state, const spanvec& words){
+    if (words.size() != 2)
+        throw yshell_exn ("usage: find pattern");
+    state.find(words.at(1).str(), state.out());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_grep (inode_state& state, const spanvec& words){
+    if (words.size() < 2)
+        throw yshell_exn ("usage: grep word...");
+    wordvec query;
+    for (size_t i = 1; i < words.size(); i++)
+        query.push_back(words[i].str());
+    state.grep(query, state.out());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_ls (inode_state& state, const spanvec& words){
     if (words.size() == 1)
-        state.ls(cout);
+        state.ls(state.out());
     else
         for (size_t i = 1; i < words.size(); i++)
-            state.ls(words.at(i), cout);
+            state.ls(words.at(i).str(), state.out());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_load (inode_state& state, const spanvec& words){
+    if (words.size() != 2)
+        throw yshell_exn ("usage: load filename");
+    state.load(words.at(1).str());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_lsr (inode_state& state, const wordvec& words){
+void fn_lsr (inode_state& state, const spanvec& words){
     if (words.size() == 1)
-        state.lsr(cout);
+        state.lsr(state.out());
     else
         for (size_t i = 1; i < words.size(); i++)
-            state.lsr(words.at(i), cout);
+            state.lsr(words.at(i).str(), state.out());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_make (inode_state& state, const wordvec& words){
+void fn_make (inode_state& state, const spanvec& words){
+    if (words.size() < 2)
+        throw yshell_exn("make: must specify filename");
     if (words.at(1).back() == '/')
-        throw yshell_exn("make: " +words.at(1)+ ": invalid filename");
+        throw yshell_exn("make: " + words.at(1).str()
+                         + ": invalid filename");
     if (words.size() == 2)
-        state.make(words.at(1));
-    else if (words.size() > 2) {
-        wordvec args(words.begin() + 2, words.end());
-        state.make(words.at(1), args);
-    } else {
-        throw yshell_exn("make: must specify filename");
-    }
+        state.make(words.at(1).str());
+    else
+        state.make(words.at(1).str(), words.begin() + 2, words.end());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_mkdir (inode_state& state, const wordvec& words){
+void fn_mkdir (inode_state& state, const spanvec& words){
     DEBUGF ('c', state);
     DEBUGF ('c', words);
     if (words.size() != 2) 
         throw yshell_exn ("usage: mkdir dirname");
-    state.mkdir(words.at(1));
+    state.mkdir(words.at(1).str());
 }
 
-void fn_prompt (inode_state& state, const wordvec& words){
+void fn_import (inode_state& state, const spanvec& words){
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+    if (words.size() != 3)
+        throw yshell_exn ("usage: import dirname hostdir");
+    state.import(words.at(1).str(), words.at(2).str());
+}
+
+void fn_prompt (inode_state& state, const spanvec& words){
     state.set_prompt(words);
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_pwd (inode_state& state, const wordvec& words){
-    state.pwd(cout);
+void fn_pwd (inode_state& state, const spanvec& words){
+    state.pwd(state.out());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_rm (inode_state& state, const wordvec& words){
+void fn_restore (inode_state& state, const spanvec& words){
+    if (words.size() != 2)
+        throw yshell_exn ("usage: restore name");
+    state.restore(words.at(1).str());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_rm (inode_state& state, const spanvec& words){
     if (words.size() != 2) 
         throw yshell_exn ("usage: rm pathname");
-    state.rm(words.at(1));
+    state.rm(words.at(1).str());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
 
-void fn_rmr (inode_state& state, const wordvec& words){
+void fn_rmr (inode_state& state, const spanvec& words){
     if (words.size() != 2) 
         throw yshell_exn ("usage: rm pathname");
-    state.rmr(words.at(1));
+    state.rmr(words.at(1).str());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_save (inode_state& state, const spanvec& words){
+    if (words.size() != 2)
+        throw yshell_exn ("usage: save filename");
+    state.save(words.at(1).str());
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_snapshot (inode_state& state, const spanvec& words){
+    if (words.size() == 1)
+        state.list_snapshots(state.out());
+    else if (words.size() == 2)
+        state.snapshot(words.at(1).str());
+    else
+        throw yshell_exn ("usage: snapshot [name]");
+    DEBUGF ('c', state);
+    DEBUGF ('c', words);
+}
+
+void fn_stats (inode_state& state, const spanvec& words){
+    if (words.size() != 1)
+        throw yshell_exn ("usage: stats");
+    state.stats(state.out());
     DEBUGF ('c', state);
     DEBUGF ('c', words);
 }
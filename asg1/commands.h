@@ -6,7 +6,8 @@
 #ifndef __COMMANDS_H__
 #define __COMMANDS_H__
 
-#include <map>
+#include <cstdint>
+#include <vector>
 using namespace std;
 
 #include "inode.h"
@@ -16,28 +17,49 @@ using namespace std;
 // A couple of convenient usings to avoid verbosity.
 //
 
-using command_fn = void (*)(inode_state& state, const wordvec& words);
-using command_map = map<string,command_fn>;
+using command_fn = void (*)(inode_state& state, const spanvec& words);
 
 //
 // commands -
 //    A class to hold and dispatch each of the command functions.
-//    Each command "foo" is interpreted by a command_fn fn_foo.
+//    Each command "foo" is interpreted by a command_fn fn_foo, and
+//    is registered by adding it to the table in commands.cpp.
+//    Dispatch is through a perfect hash:  the slot of a word is its
+//    hash times a multiplier, keeping the top bits, and the
+//    multiplier is chosen so that every command has a slot of its
+//    own.  Finding a command is one hash and one comparison.
 // ctor -
-//    The default ctor initializes the map.
-// operator[] -
-//    Given a string, returns a command_fn associated with it,
-//    or 0 if not found.
+//    Chooses the multiplier and fills in the slots.  Throws a
+//    logic_error if no multiplier separates the commands.
+// at -
+//    Given a word, returns the command_fn associated with it.
+//    Throws an yshell_exn if there is none.
 //
 
 class commands {
    private:
+      struct entry {
+         const char* name;
+         command_fn fn;
+      };
+      struct slot {
+         const char* name;
+         size_t length;
+         command_fn fn;
+      };
+      static const entry table[];
       commands (const inode&) = delete; // copy ctor
       commands& operator= (const inode&) = delete; // operator=
-      command_map map;
+      vector<slot> slots;
+      uint64_t multiplier {0};
+      int shift {0};
+      static uint64_t hash (const char* name, size_t length);
+      size_t slot_of (const char* name, size_t length) const {
+         return (hash (name, length) * multiplier) >> shift;
+      }
    public:
       commands();
-      command_fn at (const string& cmd);
+      command_fn at (const word_span& cmd) const;
 };
 
 
@@ -46,18 +68,27 @@ class commands {
 //    See the man page for a description of each of these functions.
 //
 
-void fn_cat    (inode_state& state, const wordvec& words);
-void fn_cd     (inode_state& state, const wordvec& words);
-void fn_echo   (inode_state& state, const wordvec& words);
-void fn_exit   (inode_state& state, const wordvec& words);
-void fn_ls     (inode_state& state, const wordvec& words);
-void fn_lsr    (inode_state& state, const wordvec& words);
-void fn_make   (inode_state& state, const wordvec& words);
-void fn_mkdir  (inode_state& state, const wordvec& words);
-void fn_prompt (inode_state& state, const wordvec& words);
-void fn_pwd    (inode_state& state, const wordvec& words);
-void fn_rm     (inode_state& state, const wordvec& words);
-void fn_rmr    (inode_state& state, const wordvec& words);
+void fn_cat    (inode_state& state, const spanvec& words);
+void fn_cd     (inode_state& state, const spanvec& words);
+void fn_du     (inode_state& state, const spanvec& words);
+void fn_echo   (inode_state& state, const spanvec& words);
+void fn_exit   (inode_state& state, const spanvec& words);
+void fn_find   (inode_state& state, const spanvec& words);
+void fn_grep   (inode_state& state, const spanvec& words);
+void fn_import (inode_state& state, const spanvec& words);
+void fn_ls     (inode_state& state, const spanvec& words);
+void fn_load   (inode_state& state, const spanvec& words);
+void fn_lsr    (inode_state& state, const spanvec& words);
+void fn_make   (inode_state& state, const spanvec& words);
+void fn_mkdir  (inode_state& state, const spanvec& words);
+void fn_prompt (inode_state& state, const spanvec& words);
+void fn_pwd    (inode_state& state, const spanvec& words);
+void fn_restore(inode_state& state, const spanvec& words);
+void fn_rm     (inode_state& state, const spanvec& words);
+void fn_rmr    (inode_state& state, const spanvec& words);
+void fn_save   (inode_state& state, const spanvec& words);
+void fn_snapshot(inode_state& state, const spanvec& words);
+void fn_stats   (inode_state& state, const spanvec& words);
 
 //
 // exit_status_message -
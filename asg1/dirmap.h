@@ -0,0 +1,81 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Jan 25
+
+#ifndef __DIRMAP_H__
+#define __DIRMAP_H__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+//
+// class dirmap -
+//
+// Maps directory entry names onto values.  Entries are kept densely
+// in insertion order and found through an open-addressing hash
+// table with linear probing.  The hash of each name is cached with
+// the entry, so probes compare hashes before comparing strings and
+// growing the table never rehashes a name.
+//
+// find -
+//    Returns a pointer to the value for the name, or nullptr.
+// insert -
+//    Adds the entry and returns true, or returns false if the name
+//    is already present.
+// erase -
+//    Removes the entry and returns true, or returns false if the
+//    name is not present.  The last entry is moved into the hole.
+// begin, end -
+//    Iterate over the entries in no particular order.
+// sorted -
+//    The entries ordered by name, as ls prints them.  The order is
+//    built on first use after a change and cached until the next.
+//    A copy rebuilds its own order, since the cached one points
+//    into the original's entries.  Threads may share a dirmap that
+//    none of them changes, so the order is built under a lock, and
+//    only the first to find it missing builds it.
+//
+
+template <typename mapped_t>
+class dirmap {
+   public:
+      struct entry {
+         string name;
+         size_t hash;
+         mapped_t value;
+      };
+      using const_iterator = typename vector<entry>::const_iterator;
+   private:
+      static constexpr size_t EMPTY = size_t (-1);
+      vector<entry> entries;
+      vector<size_t> slots {vector<size_t> (8, EMPTY)};
+      mutable vector<const entry*> sorted_view;
+      mutable atomic<bool> sorted_valid {true};
+      static mutex sort_lock;
+      size_t probe (const string& name, size_t hash) const;
+      void grow();
+   public:
+      dirmap() = default;
+      dirmap (const dirmap& that);
+      dirmap (dirmap&& that);
+      dirmap& operator= (const dirmap& that);
+      dirmap& operator= (dirmap&& that);
+      mapped_t* find (const string& name);
+      const mapped_t* find (const string& name) const;
+      bool insert (const string& name, const mapped_t& value);
+      bool erase (const string& name);
+      void clear();
+      size_t size() const { return entries.size(); }
+      const_iterator begin() const { return entries.cbegin(); }
+      const_iterator end() const { return entries.cend(); }
+      const vector<const entry*>& sorted() const;
+};
+
+#include "dirmap.tcc"
+#endif
+
@@ -0,0 +1,170 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Jan 25
+
+#include <algorithm>
+#include <functional>
+
+#include "dirmap.h"
+
+template <typename mapped_t>
+constexpr size_t dirmap<mapped_t>::EMPTY;
+
+template <typename mapped_t>
+mutex dirmap<mapped_t>::sort_lock;
+
+// Returns the slot holding the name, or the empty slot at which the
+// probe sequence for it ends.  The table always has an empty slot.
+template <typename mapped_t>
+size_t dirmap<mapped_t>::probe (const string& name,
+                                size_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        size_t index = slots[slot];
+        if (index == EMPTY)
+            return slot;
+        const entry& ent = entries[index];
+        if (ent.hash == hash && ent.name == name)
+            return slot;
+    }
+}
+
+// Doubles the number of slots and reinserts every entry by its
+// cached hash.
+template <typename mapped_t>
+void dirmap<mapped_t>::grow() {
+    vector<size_t> larger (slots.size() * 2, EMPTY);
+    size_t mask = larger.size() - 1;
+    for (size_t index = 0; index < entries.size(); ++index) {
+        size_t slot = entries[index].hash & mask;
+        while (larger[slot] != EMPTY)
+            slot = (slot + 1) & mask;
+        larger[slot] = index;
+    }
+    slots.swap (larger);
+}
+
+template <typename mapped_t>
+dirmap<mapped_t>::dirmap (const dirmap& that):
+            entries (that.entries), slots (that.slots),
+            sorted_valid (entries.empty()) {
+}
+
+template <typename mapped_t>
+dirmap<mapped_t>& dirmap<mapped_t>::operator= (const dirmap& that) {
+    if (this != &that) {
+        entries = that.entries;
+        slots = that.slots;
+        sorted_view.clear();
+        sorted_valid = entries.empty();
+    }
+    return *this;
+}
+
+// Moving the entries keeps their addresses, so the order moves too.
+template <typename mapped_t>
+dirmap<mapped_t>::dirmap (dirmap&& that):
+            entries (move (that.entries)), slots (move (that.slots)),
+            sorted_view (move (that.sorted_view)),
+            sorted_valid (that.sorted_valid.load()) {
+}
+
+template <typename mapped_t>
+dirmap<mapped_t>& dirmap<mapped_t>::operator= (dirmap&& that) {
+    entries = move (that.entries);
+    slots = move (that.slots);
+    sorted_view = move (that.sorted_view);
+    sorted_valid = that.sorted_valid.load();
+    return *this;
+}
+
+template <typename mapped_t>
+mapped_t* dirmap<mapped_t>::find (const string& name) {
+    size_t index = slots[probe (name, hash<string>() (name))];
+    return index == EMPTY ? nullptr : &entries[index].value;
+}
+
+template <typename mapped_t>
+const mapped_t* dirmap<mapped_t>::find (const string& name) const {
+    size_t index = slots[probe (name, hash<string>() (name))];
+    return index == EMPTY ? nullptr : &entries[index].value;
+}
+
+template <typename mapped_t>
+bool dirmap<mapped_t>::insert (const string& name,
+                               const mapped_t& value) {
+    size_t name_hash = hash<string>() (name);
+    size_t slot = probe (name, name_hash);
+    if (slots[slot] != EMPTY)
+        return false;
+    slots[slot] = entries.size();
+    entries.push_back (entry {name, name_hash, value});
+    sorted_valid = false;
+    // Keep the load factor at or below one half.
+    if (entries.size() * 2 > slots.size())
+        grow();
+    return true;
+}
+
+// Linear probing without tombstones: after emptying a slot, later
+// members of the same run are shifted back into the hole unless
+// their home slot lies cyclically after it.
+template <typename mapped_t>
+bool dirmap<mapped_t>::erase (const string& name) {
+    size_t slot = probe (name, hash<string>() (name));
+    size_t index = slots[slot];
+    if (index == EMPTY)
+        return false;
+    size_t mask = slots.size() - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; slots[next] != EMPTY;
+         next = (next + 1) & mask) {
+        size_t home = entries[slots[next]].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole] = EMPTY;
+
+    // Move the last entry into the vacated position.
+    size_t last = entries.size() - 1;
+    if (index != last) {
+        const entry& moved = entries[last];
+        slots[probe (moved.name, moved.hash)] = index;
+        entries[index] = std::move (entries[last]);
+    }
+    entries.pop_back();
+    sorted_valid = false;
+    return true;
+}
+
+template <typename mapped_t>
+void dirmap<mapped_t>::clear() {
+    entries.clear();
+    slots.assign (8, EMPTY);
+    sorted_view.clear();
+    sorted_valid = true;
+}
+
+template <typename mapped_t>
+const vector<const typename dirmap<mapped_t>::entry*>&
+dirmap<mapped_t>::sorted() const {
+    if (sorted_valid.load (memory_order_acquire))
+        return sorted_view;
+    lock_guard<mutex> guard (sort_lock);
+    if (not sorted_valid.load (memory_order_relaxed)) {
+        sorted_view.clear();
+        sorted_view.reserve (entries.size());
+        for (const entry& ent: entries)
+            sorted_view.push_back (&ent);
+        sort (sorted_view.begin(), sorted_view.end(),
+              [] (const entry* left, const entry* right) {
+                  return left->name < right->name;
+              });
+        sorted_valid.store (true, memory_order_release);
+    }
+    return sorted_view;
+}
+
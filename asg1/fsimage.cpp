@@ -0,0 +1,157 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Jan 25
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "fsimage.h"
+#include "util.h"
+
+static const char IMAGE_MAGIC[8] = {'Y','S','H','I','M','G','3','\n'};
+
+static uint64_t align8 (uint64_t size) {
+   return (size + 7) & ~uint64_t (7);
+}
+
+// Opens the file or directory only to wait for what has been
+// written to it, or its entries, to reach the disk.
+static bool sync_file (const string& filename) {
+   int fd = open (filename.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   bool synced = fsync (fd) == 0;
+   int error = errno;
+   close (fd);
+   errno = error;
+   return synced;
+}
+
+uint64_t image_writer::add_name (const string& name) {
+   uint64_t offset = pool.size();
+   pool += name;
+   return offset;
+}
+
+uint64_t image_writer::add_data (const string& bytes) {
+   uint64_t offset = data.size();
+   data += bytes;
+   return offset;
+}
+
+void image_writer::write (const string& filename) {
+   memcpy (header.magic, IMAGE_MAGIC, sizeof header.magic);
+   header.inode_count = inodes.size();
+   header.dirent_count = dirents.size();
+   header.free_count = free_nrs.size();
+   header.pool_size = pool.size();
+   header.data_size = data.size();
+   // Write a new file and rename it over the old one, since a
+   // loaded tree may still have the old one mapped.
+   string temporary = filename + ".tmp";
+   ofstream out (temporary, ios::binary | ios::trunc);
+   static const char padding[8] {};
+   auto section = [&] (const void* bytes, uint64_t size) {
+      out.write (static_cast<const char*> (bytes), size);
+      out.write (padding, align8 (size) - size);
+   };
+   section (&header, sizeof header);
+   section (inodes.data(), inodes.size() * sizeof (image_inode));
+   section (dirents.data(), dirents.size() * sizeof (image_dirent));
+   section (free_nrs.data(), free_nrs.size() * sizeof (uint32_t));
+   section (pool.data(), pool.size());
+   section (data.data(), data.size());
+   out.close();
+   if (out.fail()) {
+      int error = errno;
+      unlink (temporary.c_str());
+      throw yshell_exn ("save: " + filename + ": " + strerror (error));
+   }
+   if (not sync_file (temporary)
+       or rename (temporary.c_str(), filename.c_str()) < 0) {
+      int error = errno;
+      unlink (temporary.c_str());
+      throw yshell_exn ("save: " + filename + ": " + strerror (error));
+   }
+   size_t slash = filename.find_last_of ('/');
+   string directory = slash == string::npos ? "."
+                    : filename.substr (0, slash + 1);
+   if (not sync_file (directory))
+      throw yshell_exn ("save: " + directory + ": " + strerror (errno));
+   DEBUGF ('m', filename << ": " << inodes.size() << " inodes, "
+           << dirents.size() << " dirents");
+}
+
+fs_image::fs_image (const string& filename) {
+   int fd = open (filename.c_str(), O_RDONLY);
+   if (fd < 0)
+      throw yshell_exn ("load: " + filename + ": " + strerror (errno));
+   struct stat status;
+   if (fstat (fd, &status) < 0) {
+      close (fd);
+      throw yshell_exn ("load: " + filename + ": " + strerror (errno));
+   }
+   length = status.st_size;
+   if (length < sizeof (image_header)) {
+      close (fd);
+      throw yshell_exn ("load: " + filename + ": not an image");
+   }
+   base = mmap (nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+   close (fd);
+   if (base == MAP_FAILED) {
+      base = nullptr;
+      throw yshell_exn ("load: " + filename + ": " + strerror (errno));
+   }
+   const char* bytes = static_cast<const char*> (base);
+   header_ = reinterpret_cast<const image_header*> (bytes);
+   const image_header& head = *header_;
+   uint64_t inodes_at = align8 (sizeof head);
+   uint64_t dirents_at = inodes_at
+                       + align8 (head.inode_count * sizeof *inodes);
+   uint64_t free_at = dirents_at
+                    + align8 (head.dirent_count * sizeof *dirents);
+   uint64_t pool_at = free_at
+                    + align8 (head.free_count * sizeof *free_nrs);
+   uint64_t data_at = pool_at + align8 (head.pool_size);
+   uint64_t end = data_at + align8 (head.data_size);
+   if (memcmp (head.magic, IMAGE_MAGIC, sizeof head.magic) != 0
+       || head.inode_count > length || head.dirent_count > length
+       || head.free_count > length || head.pool_size > length
+       || head.data_size > length || end != length) {
+      munmap (base, length);
+      base = nullptr;
+      throw yshell_exn ("load: " + filename + ": not an image");
+   }
+   inodes = reinterpret_cast<const image_inode*> (bytes + inodes_at);
+   dirents = reinterpret_cast<const image_dirent*> (bytes + dirents_at);
+   free_nrs = reinterpret_cast<const uint32_t*> (bytes + free_at);
+   pool = bytes + pool_at;
+   data_ = bytes + data_at;
+   DEBUGF ('m', filename << ": " << head.inode_count << " inodes, "
+           << head.dirent_count << " dirents");
+}
+
+fs_image::~fs_image() {
+   if (base != nullptr) munmap (base, length);
+}
+
+bool fs_image::has_name (uint64_t offset, uint64_t size) const {
+   return offset <= header_->pool_size
+       && size <= header_->pool_size - offset;
+}
+
+bool fs_image::has_data (uint64_t offset, uint64_t size) const {
+   return offset <= header_->data_size
+       && size <= header_->data_size - offset;
+}
+
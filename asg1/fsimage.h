@@ -0,0 +1,139 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Jan 25
+
+#ifndef __FSIMAGE_H__
+#define __FSIMAGE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+//
+// Layout of a yshell filesystem image.  The file is the header
+// followed by five sections, each starting on an 8-byte boundary:
+//    inodes   image_inode[inode_count], in breadth first order
+//    dirents  image_dirent[dirent_count], each directory's together
+//    free     uint32_t[free_count], the inode_table's free numbers
+//    pool     the names of every inode and dirent
+//    data     the contents of every file, as cat prints them, kept
+//             once for all the files with the same contents
+// Numbers are stored in host byte order.  Every name of an inode
+// is also the name of its dirent, so is stored once.  The header's
+// log_sequence is the number of the last journal record the image
+// includes, so that recovery replays only the records after it.
+//
+
+struct image_header {
+   char magic[8];
+   uint32_t root;
+   uint32_t next_nr;
+   uint64_t inode_count;
+   uint64_t dirent_count;
+   uint64_t free_count;
+   uint64_t pool_size;
+   uint64_t data_size;
+   uint64_t log_sequence;
+};
+
+// For a directory, first and count select its dirents.  For a
+// file, they are the offset and length of its data.  An inode
+// imported from the host and not yet read has a host_length, and
+// its host path follows its name in the pool.  Such a directory has
+// only dot and dotdot, and such a file has no data, its count being
+// the size of the host file.
+struct image_inode {
+   uint64_t name_offset;
+   uint64_t first;
+   uint64_t count;
+   uint32_t name_length;
+   uint32_t nr;
+   uint32_t type;
+   uint32_t host_length;
+};
+
+struct image_dirent {
+   uint64_t name_offset;
+   uint32_t name_length;
+   uint32_t nr;
+};
+
+//
+// class image_writer -
+//
+// Accumulates the sections of an image in memory.
+// add_name -
+//    Appends a name to the pool and returns its offset.
+// add_data -
+//    Appends file contents to the data section and returns their
+//    offset.
+// write -
+//    Writes the image to the file, and returns once it is on the
+//    disk.  Throws an yshell_exn on failure.
+//
+
+class image_writer {
+   public:
+      image_header header {};
+      vector<image_inode> inodes;
+      vector<image_dirent> dirents;
+      vector<uint32_t> free_nrs;
+      uint64_t add_name (const string& name);
+      uint64_t add_data (const string& bytes);
+      void write (const string& filename);
+   private:
+      string pool;
+      string data;
+};
+
+//
+// class fs_image -
+//
+// An image mapped read-only into memory, which stays mapped for the
+// lifetime of the object so that directories can be filled in from
+// it on first use.
+// ctor -
+//    Maps the file and checks that its sections fit.  Throws an
+//    yshell_exn if it cannot be read or is not an image.
+// inode, dirent, free_nr -
+//    The i'th record of each section.
+// name, data -
+//    Pointers into the pool and the data section.  The ranges are
+//    checked by has_name and has_data.
+//
+
+class fs_image {
+   private:
+      void* base {nullptr};
+      size_t length {0};
+      const image_header* header_ {nullptr};
+      const image_inode* inodes {nullptr};
+      const image_dirent* dirents {nullptr};
+      const uint32_t* free_nrs {nullptr};
+      const char* pool {nullptr};
+      const char* data_ {nullptr};
+   public:
+      explicit fs_image (const string& filename);
+      fs_image (const fs_image&) = delete;
+      fs_image& operator= (const fs_image&) = delete;
+      ~fs_image();
+      const image_header& header() const { return *header_; }
+      const image_inode& inode (size_t i) const { return inodes[i]; }
+      const image_dirent& dirent (size_t i) const {
+         return dirents[i];
+      }
+      uint32_t free_nr (size_t i) const { return free_nrs[i]; }
+      bool has_name (uint64_t offset, uint64_t size) const;
+      bool has_data (uint64_t offset, uint64_t size) const;
+      const char* name (uint64_t offset) const {
+         return pool + offset;
+      }
+      const char* data (uint64_t offset) const {
+         return data_ + offset;
+      }
+};
+
+#endif
+
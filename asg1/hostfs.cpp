@@ -0,0 +1,109 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 22
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "hostfs.h"
+#include "util.h"
+
+static yshell_exn host_error (const string& path) {
+   return yshell_exn ("import: " + path + ": " + strerror (errno));
+}
+
+string host_directory (const string& path) {
+   char resolved[PATH_MAX];
+   if (realpath (path.c_str(), resolved) == nullptr)
+      throw host_error (path);
+   struct stat info;
+   if (stat (resolved, &info) < 0)
+      throw host_error (path);
+   if (not S_ISDIR (info.st_mode))
+      throw yshell_exn ("import: " + path + ": Not a directory");
+   return resolved;
+}
+
+// The type in the dirent saves a stat of each subdirectory, but
+// not every filesystem fills it in.
+vector<host_entry> read_host_dir (const string& path) {
+   DIR* stream = opendir (path.c_str());
+   if (stream == nullptr) throw host_error (path);
+   vector<host_entry> entries;
+   for (;;) {
+      errno = 0;
+      struct dirent* ent = readdir (stream);
+      if (ent == nullptr) break;
+      const char* name = ent->d_name;
+      if (strcmp (name, ".") == 0 or strcmp (name, "..") == 0)
+         continue;
+      if (ent->d_type == DT_DIR) {
+         entries.push_back (host_entry {name, true, 0});
+         continue;
+      }
+      if (ent->d_type != DT_REG and ent->d_type != DT_UNKNOWN)
+         continue;
+      struct stat info;
+      if (fstatat (dirfd (stream), name, &info,
+                   AT_SYMLINK_NOFOLLOW) < 0)
+         continue;
+      if (S_ISDIR (info.st_mode))
+         entries.push_back (host_entry {name, true, 0});
+      else if (S_ISREG (info.st_mode))
+         entries.push_back (host_entry {name, false,
+                                        uint64_t (info.st_size)});
+   }
+   int error = errno;
+   closedir (stream);
+   errno = error;
+   if (error != 0) throw host_error (path);
+   sort (entries.begin(), entries.end(),
+         [] (const host_entry& left, const host_entry& right) {
+            return left.name < right.name;
+         });
+   DEBUGF ('h', path << ": " << entries.size() << " entries");
+   return entries;
+}
+
+host_file::host_file (const string& path) {
+   int fd = open (path.c_str(), O_RDONLY);
+   if (fd < 0) throw host_error (path);
+   struct stat info;
+   if (fstat (fd, &info) < 0) {
+      int error = errno;
+      close (fd);
+      errno = error;
+      throw host_error (path);
+   }
+   length = info.st_size;
+   if (length > 0) {
+      base = mmap (nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (base == MAP_FAILED) {
+         int error = errno;
+         close (fd);
+         base = nullptr;
+         errno = error;
+         throw host_error (path);
+      }
+   }
+   close (fd);
+   DEBUGF ('h', path << ": " << length << " bytes");
+}
+
+host_file::~host_file() {
+   if (base != nullptr) munmap (base, length);
+}
+
@@ -0,0 +1,65 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 22
+
+#ifndef __HOSTFS_H__
+#define __HOSTFS_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+//
+// Access to the host's own filesystem, for import.  Errors are
+// thrown as an yshell_exn naming the host path.
+// host_directory -
+//    The absolute path of a host directory, with no symbolic links
+//    or dot components.  Throws if it is not a directory.
+// host_entry, read_host_dir -
+//    The directories and regular files in a host directory, in name
+//    order, so that the inode numbers given to them do not depend
+//    on the host, with the size of each file.  Anything else,
+//    symbolic links included, is left out, so a walk down a host
+//    tree cannot go around a cycle.
+//
+
+string host_directory (const string& path);
+
+struct host_entry {
+   string name;
+   bool is_dir;
+   uint64_t size;
+};
+
+vector<host_entry> read_host_dir (const string& path);
+
+//
+// class host_file -
+//
+// A host file mapped read-only into memory for as long as the
+// object lives.  An empty file is not mapped.
+// ctor -
+//    Maps the file.  Throws an yshell_exn if it cannot be read.
+// data, size -
+//    The bytes of the file.
+//
+
+class host_file {
+   private:
+      void* base {nullptr};
+      size_t length {0};
+   public:
+      explicit host_file (const string& path);
+      host_file (const host_file&) = delete;
+      host_file& operator= (const host_file&) = delete;
+      ~host_file();
+      const char* data() const {
+         return static_cast<const char*> (base);
+      }
+      size_t size() const { return length; }
+};
+
+#endif
+
@@ -3,30 +3,254 @@
 // ID:      1253060
 // Date:    2015 Jan 18
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <iomanip>
+#include <mutex>
+#include <new>
+#include <thread>
 
 using namespace std;
 
 #include "debug.h"
+#include "fsimage.h"
+#include "hostfs.h"
 #include "inode.h"
 
-int inode::next_inode_nr {1};
+constexpr size_t inode_table::CHUNK_SIZE;
+constexpr size_t inode_table::FANOUT;
 
-inode::inode(inode_t init_type):
-   inode_nr (next_inode_nr++), type (init_type)
-{
+// A copy of a chunk copies only the slots in use.
+inode_table::chunk::chunk (const chunk& that): node() {
+   for (size_t i = 0; i < CHUNK_SIZE; ++i)
+      if (that.slots[i].inode_nr != NO_INODE)
+         slots[i].construct (that.slots[i]);
+}
+
+// A long stack is dropped a block at a time rather than by each
+// block's destructor calling the next one's.
+inode_table::free_block::~free_block() {
+   while (rest != nullptr && rest.use_count() == 1)
+      rest = move (rest->rest);
+}
+
+// The chunk holding the given chunk index, or nullptr if there is
+// none.
+const inode_table::chunk* inode_table::find_chunk (size_t index)
+                                                   const {
+   if ((index >> (height * FANOUT_BITS)) != 0)
+      return nullptr;
+   const node* part = top.get();
+   for (int level = height; part != nullptr && level > 0; --level) {
+      size_t below = (index >> ((level - 1) * FANOUT_BITS)) % FANOUT;
+      part = static_cast<const branch*> (part)->below[below].get();
+   }
+   return static_cast<const chunk*> (part);
+}
+
+// Returns the slot for the inode number, first growing the tree
+// until it reaches the number, then copying each branch on the way
+// down and the chunk if another table shares them.
+inode& inode_table::slot (inode_id nr) {
+   size_t index = nr / CHUNK_SIZE;
+   while ((index >> (height * FANOUT_BITS)) != 0) {
+      auto above = make_shared<branch>();
+      above->below[0] = move (top);
+      top = move (above);
+      ++height;
+   }
+   shared_ptr<node>* part = &top;
+   for (int level = height; level > 0; --level) {
+      if (*part == nullptr)
+         *part = make_shared<branch>();
+      else if (part->use_count() > 1)
+         *part = make_shared<branch> (
+                    static_cast<const branch&> (**part));
+      size_t below = (index >> ((level - 1) * FANOUT_BITS)) % FANOUT;
+      part = &static_cast<branch&> (**part).below[below];
+   }
+   if (*part == nullptr) {
+      *part = make_shared<chunk>();
+   } else if (part->use_count() > 1) {
+      DEBUGF ('s', "copy chunk " << index);
+      *part = make_shared<chunk> (static_cast<const chunk&> (**part));
+   }
+   return static_cast<chunk&> (**part).slots[nr % CHUNK_SIZE];
+}
+
+// The top block is copied before it is changed if another table
+// shares it.  Only the top block is ever partly full.
+void inode_table::push_free (inode_id nr) {
+   if (free_nrs == nullptr || free_nrs->count == CHUNK_SIZE) {
+      auto block = make_shared<free_block>();
+      block->rest = move (free_nrs);
+      free_nrs = move (block);
+   } else if (free_nrs.use_count() > 1) {
+      free_nrs = make_shared<free_block> (*free_nrs);
+   }
+   free_nrs->nrs[free_nrs->count++] = nr;
+}
+
+inode_id inode_table::pop_free() {
+   inode_id nr = free_nrs->nrs[free_nrs->count - 1];
+   if (free_nrs->count == 1) {
+      free_nrs = free_nrs->rest;
+      return nr;
+   }
+   if (free_nrs.use_count() > 1)
+      free_nrs = make_shared<free_block> (*free_nrs);
+   --free_nrs->count;
+   return nr;
+}
+
+inode_id inode_table::allocate (inode_t type) {
+   inode_id nr;
+   if (free_nrs == nullptr)
+      nr = next_nr++;
+   else
+      nr = pop_free();
+   allocate_at (nr, type);
+   DEBUGF ('i', "inode " << nr << ", type = " << type);
+   return nr;
+}
+
+void inode_table::release (inode_id nr) {
+   DEBUGF ('i', "inode " << nr);
+   slot (nr).destroy();
+   push_free (nr);
+}
+
+void inode_table::allocate_at (inode_id nr, inode_t type) {
+   slot (nr).construct (nr, type);
+}
+
+vector<inode_id> inode_table::free_numbers() const {
+   vector<inode_id> free;
+   for (const free_block* block = free_nrs.get(); block != nullptr;
+        block = block->rest.get())
+      for (size_t i = block->count; i > 0; --i)
+         free.push_back (block->nrs[i - 1]);
+   reverse (free.begin(), free.end());
+   return free;
+}
+
+void inode_table::set_numbers (inode_id next,
+                               const vector<inode_id>& free) {
+   next_nr = next;
+   free_nrs.reset();
+   for (inode_id nr: free)
+      push_free (nr);
+}
+
+const inode& inode_table::at (inode_id nr) const {
+   return find_chunk (nr / CHUNK_SIZE)->slots[nr % CHUNK_SIZE];
+}
+
+bool inode_table::in_use (inode_id nr) const {
+   const chunk* part = find_chunk (nr / CHUNK_SIZE);
+   return part != nullptr
+       && part->slots[nr % CHUNK_SIZE].inode_nr != NO_INODE;
+}
+
+inode& inode_table::edit (inode_id nr) {
+   return slot (nr);
+}
+
+// The child at the index of a node at the given level, in a tree
+// whose top is at part_height.  Above its top, a tree is taken as
+// having only a first child.
+const inode_table::node* inode_table::child (const node* part,
+                                             int part_height,
+                                             int level, size_t index) {
+   if (part == nullptr)
+      return nullptr;
+   if (level > part_height)
+      return index == 0 ? part : nullptr;
+   return static_cast<const branch*> (part)->below[index].get();
+}
+
+void inode_table::compare (const node* mine, int my_height,
+                           const node* theirs, int their_height,
+                           int level, const slot_visitor& visit) {
+   if (mine == theirs)
+      return;
+   if (level > 0) {
+      for (size_t i = 0; i < FANOUT; ++i)
+         compare (child (mine, my_height, level, i), my_height,
+                  child (theirs, their_height, level, i), their_height,
+                  level - 1, visit);
+      return;
+   }
+   auto in_use = [] (const node* part, size_t i) -> const inode* {
+      if (part == nullptr) return nullptr;
+      const inode& each = static_cast<const chunk*> (part)->slots[i];
+      return each.inode_nr == NO_INODE ? nullptr : &each;
+   };
+   for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+      const inode* mine_slot = in_use (mine, i);
+      const inode* theirs_slot = in_use (theirs, i);
+      if (mine_slot != nullptr || theirs_slot != nullptr)
+         visit (mine_slot, theirs_slot);
+   }
+}
+
+void inode_table::compare (const inode_table& that,
+                           const slot_visitor& visit) const {
+   compare (top.get(), height, that.top.get(), that.height,
+            max (height, that.height), visit);
+}
+
+void inode::construct (inode_id nr, inode_t init_type) {
+   inode_nr = nr;
+   type = init_type;
    switch (type) {
       case PLAIN_INODE:
-           contents = make_shared<plain_file>();
+           new (&file_contents) plain_file();
            break;
       case DIR_INODE:
-           contents = make_shared<directory>();
+           new (&dir_contents) directory();
            break;
    }
-   DEBUGF ('i', "inode " << inode_nr << ", type = " << type);
+}
+
+void inode::construct (const inode& that) {
+   inode_nr = that.inode_nr;
+   type = that.type;
+   name = that.name;
+   switch (type) {
+      case PLAIN_INODE:
+           new (&file_contents) plain_file (that.file_contents);
+           break;
+      case DIR_INODE:
+           new (&dir_contents) directory (that.dir_contents);
+           break;
+   }
+}
+
+void inode::destroy() {
+   if (inode_nr == NO_INODE) return;
+   switch (type) {
+      case PLAIN_INODE:
+           file_contents.~plain_file();
+           break;
+      case DIR_INODE:
+           dir_contents.~directory();
+           break;
+   }
+   inode_nr = NO_INODE;
+   name.clear();
+}
+
+inode::~inode() {
+   destroy();
 }
 
 int inode::get_inode_nr() const {
@@ -38,15 +262,12 @@ int inode::get_type() const {
     return type;
 }
 
-file_base_ptr inode::get_contents() const{
-    return contents;
-}
-
 size_t inode::size() const {
-    if (type == PLAIN_INODE)
-        return plain_file_ptr_of(contents)->size();
-    else
-        return directory_ptr_of(contents)->size();
+    switch (type) {
+        case PLAIN_INODE: return file_contents.size();
+        case DIR_INODE:   return dir_contents.size();
+    }
+    return 0;
 }
 
 void inode::set_name(const string& iname) {
@@ -57,239 +278,709 @@ string inode::get_name() const {
     return name;
 }
 
-plain_file_ptr plain_file_ptr_of (file_base_ptr ptr) {
-   plain_file_ptr pfptr = dynamic_pointer_cast<plain_file> (ptr);
-   if (pfptr == nullptr) throw invalid_argument ("plain_file_ptr_of");
-   return pfptr;
+plain_file& inode::file() {
+   if (type != PLAIN_INODE) throw yshell_exn (name + ": Not a file");
+   return file_contents;
 }
 
-directory_ptr directory_ptr_of (file_base_ptr ptr) {
-   directory_ptr dirptr = dynamic_pointer_cast<directory> (ptr);
-   if (dirptr == nullptr) throw invalid_argument ("directory_ptr_of");
-   return dirptr;
+const plain_file& inode::file() const {
+   if (type != PLAIN_INODE) throw yshell_exn (name + ": Not a file");
+   return file_contents;
 }
 
-size_t plain_file::size() const {
-   size_t size {0};
-   size = data.size();
-   for (auto word = data.begin();
-             word != data.end();
-             word++) {
-      size += word->size();
+directory& inode::dir() {
+   if (type != DIR_INODE) throw yshell_exn (name + ": Not a directory");
+   return dir_contents;
+}
+
+const directory& inode::dir() const {
+   if (type != DIR_INODE) throw yshell_exn (name + ": Not a directory");
+   return dir_contents;
+}
+
+mutex blob_pool::lock;
+unordered_multimap<size_t,blob_pool::entry> blob_pool::blobs;
+
+// A blob in the pool is not deleted until release has taken it out,
+// which needs the lock, so while it is held every address in the
+// pool may be read.  A blob whose last owner has gone but which
+// release has not yet taken out cannot be locked, and is passed by.
+shared_ptr<const blob_pool::blob> blob_pool::intern (string&& bytes,
+                                       vector<size_t>&& offsets) {
+   size_t code = hash<string>() (bytes);
+   lock_guard<mutex> guard (lock);
+   auto range = blobs.equal_range (code);
+   for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.address->bytes != bytes) continue;
+      shared_ptr<const blob> found = it->second.owner.lock();
+      if (found != nullptr) return found;
    }
-   if (size > 1) size -= 1;
-   DEBUGF ('i', "size = " << size);
-   return size;
+   shared_ptr<const blob> made (new blob {move (bytes), move (offsets),
+                                          code}, release);
+   blobs.emplace (code, entry {made.get(), made});
+   return made;
+}
+
+void blob_pool::release (const blob* gone) {
+   {
+      lock_guard<mutex> guard (lock);
+      auto range = blobs.equal_range (gone->hash);
+      for (auto it = range.first; it != range.second; ++it) {
+         if (it->second.address == gone) {
+            blobs.erase (it);
+            break;
+         }
+      }
+   }
+   delete gone;
 }
 
-const wordvec& plain_file::readfile() const {
-   DEBUGF ('i', data);
-   return data;
+blob_pool::totals blob_pool::usage() {
+   totals sum {0, 0, 0, 0};
+   lock_guard<mutex> guard (lock);
+   for (const auto& it: blobs) {
+      size_t files = it.second.owner.use_count();
+      if (files == 0) continue;
+      size_t bytes = it.second.address->bytes.size();
+      sum.blobs += 1;
+      sum.files += files;
+      sum.stored += bytes;
+      sum.shared += bytes * files;
+   }
+   return sum;
+}
+
+const string& plain_file::readfile() const {
+   static const string empty;
+   return contents == nullptr ? empty : contents->bytes;
 }
 
-void plain_file::writefile (const wordvec& words) {
-   DEBUGF ('i', words);
-   data = words;
+string plain_file::word (size_t index) const {
+   const string& bytes = contents->bytes;
+   const vector<size_t>& offsets = contents->offsets;
+   size_t end = index + 1 < offsets.size()
+              ? offsets[index + 1] - 1 : bytes.size();
+   return bytes.substr (offsets[index], end - offsets[index]);
+}
+
+void plain_file::import (const string& path, size_t bytes) {
+   contents.reset();
+   host = path;
+   host_bytes = bytes;
+}
+
+void plain_file::writebytes (const char* data, size_t length) {
+   host.clear();
+   if (length == 0) {
+      contents.reset();
+      return;
+   }
+   string bytes (data, length);
+   vector<size_t> offsets {0};
+   for (size_t i = 0; i < length; ++i)
+      if (bytes[i] == ' ') offsets.push_back (i + 1);
+   contents = blob_pool::intern (move (bytes), move (offsets));
+}
+
+void plain_file::readwords (const char* data, size_t length) {
+   host.clear();
+   string bytes;
+   vector<size_t> offsets;
+   const char* end = data + length;
+   for (const char* next = data; next < end; ) {
+      if (isspace (static_cast<unsigned char> (*next))) {
+         ++next;
+         continue;
+      }
+      const char* word = next;
+      while (next < end
+             and not isspace (static_cast<unsigned char> (*next)))
+         ++next;
+      if (not offsets.empty()) bytes += ' ';
+      offsets.push_back (bytes.size());
+      bytes.append (word, next);
+   }
+   DEBUGF ('i', offsets.size() << " words, size = " << bytes.size());
+   if (offsets.empty())
+      contents.reset();
+   else
+      contents = blob_pool::intern (move (bytes), move (offsets));
+}
+
+void plain_file::writefile (span_iter first, span_iter last) {
+   host.clear();
+   size_t count = last - first;
+   DEBUGF ('i', count << " words");
+   if (count == 0) {
+      contents.reset();
+      return;
+   }
+   size_t length = count - 1;
+   for (span_iter word = first; word != last; ++word)
+      length += word->size;
+   string bytes;
+   bytes.reserve (length);
+   vector<size_t> offsets;
+   offsets.reserve (count);
+   for (span_iter word = first; word != last; ++word) {
+      if (not offsets.empty()) bytes += ' ';
+      offsets.push_back (bytes.size());
+      bytes.append (word->data, word->size);
+   }
+   DEBUGF ('i', "size = " << bytes.size());
+   contents = blob_pool::intern (move (bytes), move (offsets));
 }
 
 size_t directory::size() const {
+   // The count never changes, so may be read while another thread
+   // fills in the dirents.
    size_t size {0};
-   size = dirents.size();
+   if (not filled.load (memory_order_acquire))
+      size = pending.count;
+   else
+      size = dirents->size();
    DEBUGF ('i', "size = " << size);
    return size;
 }
 
-void directory::remove (const string& filename,
+void directory::remove (inode_table& table, const string& filename,
                         const string& pathname) {
-    auto it = dirents.find(filename);
-    if (it == dirents.end())
+    const inode_id* it = loaded().find(filename);
+    if (it == nullptr)
         throw yshell_exn ("rm: " + pathname 
                                  + ": no such file or directory");
-    if (it->second->get_type() == PLAIN_INODE)
-        dirents.erase(it);
-    else {
-        inode_ptr p = it->second;
-        directory_ptr dp = directory_ptr_of(p->get_contents()); 
-        if (dp->size() != 2)
+    inode_id nr = *it;
+    if (table.at(nr).get_type() == DIR_INODE) {
+        if (table.at(nr).dir().size() != 2)
             throw yshell_exn ("rm: " + pathname
                                      + ": directory must be empty");
-        dirents.erase(it);
     }
+    writable().erase(filename);
+    table.release(nr);
    DEBUGF ('i', filename);
 }
 
-void directory::remove_r (const string& filename,
-                          const string& pathname) {
-    auto it = dirents.find(filename);
-    directory_ptr dp; 
-    if (it == dirents.end())
+inode_id directory::remove_r (const string& filename,
+                              const string& pathname) {
+    const inode_id* it = loaded().find(filename);
+    if (it == nullptr)
         throw yshell_exn ("rmr: " + pathname 
                                   + ": no such directory");
-    dp = directory_ptr_of(it->second->get_contents());
-    dp->rec_empty();
-    dirents.erase(it->first);
+    inode_id nr = *it;
+    writable().erase(filename);
    DEBUGF ('i', filename);
+    return nr;
 }
 
-void directory::rec_empty() {
-    inode_ptr p;
-    directory_ptr dp;
-    for (auto it =  dirents.begin();
-              it != dirents.end();
-              ) {
-        p = it->second;
-        DEBUGF ('i', it->first);
-        if (it->first == "." || it->first == "..") {
-            dirents.erase(it++);
-            continue;
-        }
-        if (p->get_type() == PLAIN_INODE)
-            dirents.erase(it++);
-        else {
-            dp = directory_ptr_of(p->get_contents());
-            dp->rec_empty();
-            dirents.erase(it++);
+// Called on the reclaimer's thread, so a directory still in the
+// image is read from it directly rather than filled in.
+void directory::children(vector<inode_id>& numbers) const {
+    if (not filled.load(memory_order_acquire)) {
+        lock_guard<mutex> guard (fill_lock);
+        if (not filled.load(memory_order_relaxed)) {
+            for (uint64_t i = 0; i < pending.count; ++i) {
+                const image_dirent& ent = pending.image->dirent
+                                          (pending.first + i);
+                string name (pending.image->name(ent.name_offset),
+                             ent.name_length);
+                if (name == "." || name == "..")
+                    continue;
+                numbers.push_back(ent.nr);
+            }
+            return;
         }
     }
+    for (auto it =  dirents->begin();
+              it != dirents->end();
+              it++) {
+        if (it->name == "." || it->name == "..")
+            continue;
+        numbers.push_back(it->value);
+    }
 }
 
-vector<inode_ptr> directory::subdirs() {
-    vector<inode_ptr> subdirs;
-    for (auto it = dirents.begin();
-              it != dirents.end();
-              ++it) {
-        if (it->second->get_type() == DIR_INODE
-            && it->first != "."
-            && it->first != "..")
-            subdirs.push_back(it->second);
-    }
-    return subdirs;
+void directory::unlink_parent() {
+    writable().erase("..");
+    parent_nr = NO_INODE;
 }
 
-inode_ptr directory::mkdir(const string& dirname) {
+void directory::defer (shared_ptr<const fs_image> image,
+                       uint64_t first, uint64_t count) {
+   dirents = make_shared<dirmap<inode_id>>();
+   pending = image_range {image, first, count};
+   filled = false;
+}
+
+// A copy shares the dirents once they are filled in.  Until then
+// it takes the same range of the image and a dirmap of its own, so
+// that copying a chunk fills in none of its directories and the
+// two never both fill in the same dirmap.
+directory::directory (const directory& that):
+           dirents (that.dirents),
+           bytes_below (that.bytes_below),
+           inodes_below (that.inodes_below),
+           unread_below (that.unread_below),
+           parent_nr (that.parent_nr), host (that.host) {
+   if (that.filled.load (memory_order_acquire)) return;
+   lock_guard<mutex> guard (fill_lock);
+   if (that.filled.load (memory_order_relaxed)) return;
+   dirents = make_shared<dirmap<inode_id>>();
+   pending = that.pending;
+   filled.store (false, memory_order_relaxed);
+}
+
+// Fills in the dirents from the image the first time they are
+// needed.  The image was checked when it was loaded.  Threads may
+// share a directory that none of them changes, so filling in is
+// done under a lock, and only by the first to find it needed.
+mutex directory::fill_lock;
+
+const dirmap<inode_id>& directory::loaded() const {
+   if (filled.load (memory_order_acquire))
+      return *dirents;
+   lock_guard<mutex> guard (fill_lock);
+   if (not filled.load (memory_order_relaxed)) {
+      for (uint64_t i = 0; i < pending.count; ++i) {
+         const image_dirent& ent = pending.image->dirent
+                                   (pending.first + i);
+         dirents->insert (string (pending.image->name
+                                  (ent.name_offset), ent.name_length),
+                          ent.nr);
+      }
+      pending.image.reset();
+      filled.store (true, memory_order_release);
+   }
+   return *dirents;
+}
+
+// The dirents for changing, copied first if another directory
+// shares them.
+dirmap<inode_id>& directory::writable() {
+   loaded();
+   if (dirents.use_count() > 1)
+      dirents = make_shared<dirmap<inode_id>> (*dirents);
+   return *dirents;
+}
+
+void directory::add_below (ptrdiff_t bytes, ptrdiff_t inodes,
+                           ptrdiff_t unread) {
+   bytes_below += bytes;
+   inodes_below += inodes;
+   unread_below += unread;
+}
+
+const vector<const dirent*>& directory::entries() const {
+    return loaded().sorted();
+}
+
+// A directory still to be filled in may be filled in by another
+// thread, so its dirents are not looked at.
+bool directory::shares_dirents(const directory& that) const {
+    return filled.load(memory_order_acquire)
+        && that.filled.load(memory_order_acquire)
+        && dirents == that.dirents;
+}
+
+inode_id directory::mkdir(inode_table& table, const string& dirname) {
     DEBUGF ('i', dirname);
-    if (dirents.find(dirname) != dirents.end())
+    if (loaded().find(dirname) != nullptr)
         throw yshell_exn ("mkdir: " + dirname + ": dirname exists");
-    inode_ptr parent = dirents.at(".");
-    inode_ptr dirnode = make_shared<inode>(DIR_INODE);
-    dirnode->set_name(dirname);
-    directory_ptr dir = directory_ptr_of(dirnode->get_contents());
-    dir->set_parent_child(parent, dirnode);
-    dirents.insert(make_pair(dirname, dirnode));
+    inode_id parent = *loaded().find(".");
+    inode_id dirnode = table.allocate(DIR_INODE);
+    inode& node = table.edit(dirnode);
+    node.set_name(dirname);
+    node.dir().set_parent_child(parent, dirnode);
+    writable().insert(dirname, dirnode);
     return dirnode;
 }
 
-inode_ptr directory::mkfile (const string& filename) {
+inode_id directory::mkfile (inode_table& table,
+                            const string& filename) {
     DEBUGF ('i', filename);
-    if (dirents.find(filename) != dirents.end())
+    if (loaded().find(filename) != nullptr)
         throw logic_error ("filename exists");
-    inode_ptr file = make_shared<inode>(PLAIN_INODE);
-    dirents.insert(make_pair(filename, file));
+    inode_id file = table.allocate(PLAIN_INODE);
+    table.edit(file).set_name(filename);
+    writable().insert(filename, file);
     return file;
 }
 
-void directory::set_root(inode_ptr root) {
-    dirents.insert(make_pair(".", root));
-    dirents.insert(make_pair("..", root));
-    root->set_name("/");
+void directory::set_root(inode_table& table, inode_id root) {
+    writable().insert(".", root);
+    writable().insert("..", root);
+    parent_nr = root;
+    table.edit(root).set_name("/");
 }
 
-void directory::set_parent_child(inode_ptr parent, inode_ptr child) {
-    dirents.insert(make_pair("..", parent));
-    dirents.insert(make_pair(".", child));
+void directory::set_parent_child(inode_id parent, inode_id child) {
+    writable().insert("..", parent);
+    writable().insert(".", child);
+    parent_nr = parent;
 }
 
-inode_ptr directory::lookup(const string& name) {
-    auto it = dirents.find(name);
-    if (it == dirents.end())
-        return nullptr;
-    return it->second;
+inode_id directory::lookup(const string& name) const {
+    const inode_id* it = loaded().find(name);
+    if (it == nullptr)
+        return NO_INODE;
+    return *it;
 }
 
-void directory::ls(ostream& out) {
-    string suffix;
-    for (auto it = dirents.begin();
-              it != dirents.end();
-              it++) {
-        if (it->second->get_type() == DIR_INODE
-            && it->first != "."
-            && it->first != "..")
-            suffix = "/";
+// Listings are formatted into a string and written out in large
+// pieces, rather than line by line through the ostream.
+static constexpr size_t LISTING_FLUSH_SIZE = 1 << 16;
+
+static void append_dirent(string& buffer, const inode& node,
+                          const string& name, const char* suffix) {
+    char numbers[48];
+    int length = snprintf(numbers, sizeof numbers, "%6d%6zu\t",
+                          node.get_inode_nr(), node.size());
+    buffer.append(numbers, length);
+    buffer += name;
+    buffer += suffix;
+    buffer += '\n';
+}
+
+static void flush_listing(string& buffer, ostream& out) {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void directory::ls(const inode_table& table, string& buffer) const {
+    for (auto ent: loaded().sorted()) {
+        const inode& node = table.at(ent->value);
+        if (node.get_type() == DIR_INODE
+            && ent->name != "."
+            && ent->name != "..")
+            append_dirent(buffer, node, ent->name, "/");
         else
-            suffix = "";
-        out << setw(6) << it->second->get_inode_nr()
-            << setw(6) << it->second->size()
-            << "\t" << it->first + suffix << endl;
+            append_dirent(buffer, node, ent->name, "");
     }
 }
 
-const wordvec& directory::cat(const string& name,
-                              const string& pathname) {
-    auto it = dirents.find(name);
-    if (it == dirents.end()) {
+const string& directory::cat(const inode_table& table,
+                             const string& name,
+                             const string& pathname) const {
+    const inode_id* it = loaded().find(name);
+    if (it == nullptr) {
         throw yshell_exn ("cat: " + pathname + ": No such file");
-    } else if (it->second->get_type() == DIR_INODE) {
+    } else if (table.at(*it).get_type() == DIR_INODE) {
         throw yshell_exn ("cat: " + pathname + ": Not a file");
     } else {
-        plain_file_ptr fp = plain_file_ptr_of(
-                                it->second->get_contents());
-        return fp->readfile();
+        return table.at(*it).file().readfile();
     }
 }
 
-void directory::make(const string& name, const string& pathname) {
-    inode_ptr np;
-    auto it = dirents.find(name);
-    if (it == dirents.end()) {
-        mkfile(name);
-    } else if (it->second->get_type() == DIR_INODE) {
-        throw yshell_exn ("make: " + pathname 
-                + ": filename exists as directory");
-    } else {
-        wordvec v;
-        plain_file_ptr fp = plain_file_ptr_of(
-                                it->second->get_contents());
-        fp->writefile(v);
-    }
+void directory::make(inode_table& table, const string& name,
+                     const string& pathname) {
+    spanvec none;
+    make(table, name, pathname, none.begin(), none.end());
 }
 
-void directory::make(const string& name, 
+void directory::make(inode_table& table, const string& name, 
                      const string& pathname,
-                     wordvec& data) {
-    inode_ptr np;
-    auto it = dirents.find(name);
-    if (it == dirents.end()) {
-        np = mkfile(name);
-        plain_file_ptr fp = plain_file_ptr_of(np->get_contents());
-        fp->writefile(data);
-    } else if (it->second->get_type() == DIR_INODE) {
+                     span_iter first, span_iter last) {
+    inode_id nr;
+    const inode_id* it = loaded().find(name);
+    if (it == nullptr) {
+        nr = mkfile(table, name);
+    } else if (table.at(*it).get_type() == DIR_INODE) {
         throw yshell_exn ("make: " + pathname 
                 + ": filename exists as directory");
     } else {
-        plain_file_ptr fp = plain_file_ptr_of(
-                                it->second->get_contents());
-        fp->writefile(data);
+        nr = *it;
+    }
+    table.edit(nr).file().writefile(first, last);
+}
+
+reclaimer::~reclaimer() {
+    stop();
+}
+
+// Waits only for what the thread is doing now.  The jobs and tables
+// left are never freed, since the process is about to exit.
+void reclaimer::stop() {
+    if (not worker.joinable())
+        return;
+    {
+        lock_guard<mutex> guard (lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+// No thread is running, so stopping is not shared yet.
+void reclaimer::start() {
+    if (worker.joinable())
+        return;
+    stopping = false;
+    worker = thread (&reclaimer::run, this);
+}
+
+void reclaimer::detach(const inode_table& table, inode_id dir) {
+    start();
+    {
+        lock_guard<mutex> guard (lock);
+        waiting.push_back(job {table, dir, {}});
+        ++unwalked;
+    }
+    wake.notify_one();
+}
+
+// Releasing destroys only the shell's copy of each inode, which
+// shares its dirents and contents with the job's copy, so what the
+// subtree holds is destroyed on the thread when it drops the job.
+void reclaimer::collect(inode_table& table,
+                        const function<void(inode_id)>& releasing) {
+    deque<job> done;
+    {
+        unique_lock<mutex> guard (lock);
+        walked_all.wait(guard, [this] { return unwalked == 0; });
+        done.swap(walked);
+    }
+    if (done.empty())
+        return;
+    for (const job& each: done) {
+       DEBUGF ('i', "reclaim " << each.dir << ": "
+               << each.numbers.size() << " inodes");
+        for (inode_id nr: each.numbers) {
+            releasing(nr);
+            table.release(nr);
+        }
+    }
+    {
+        lock_guard<mutex> guard (lock);
+        for (job& each: done)
+            garbage.push_back(move(each.table));
+    }
+    wake.notify_one();
+}
+
+void reclaimer::discard(inode_table&& table) {
+    start();
+    {
+        lock_guard<mutex> guard (lock);
+        garbage.push_back(move(table));
+    }
+    wake.notify_one();
+}
+
+// Tables are dropped and subtrees walked with the lock released, so
+// the shell never waits on either except in collect.
+void reclaimer::run() {
+    unique_lock<mutex> guard (lock);
+    for (;;) {
+        wake.wait(guard, [this] {
+            return stopping || not waiting.empty()
+                || not garbage.empty();
+        });
+        if (stopping)
+            return;
+        vector<inode_table> dropped;
+        dropped.swap(garbage);
+        bool walking = not waiting.empty();
+        job work;
+        if (walking) {
+            work = move(waiting.front());
+            waiting.pop_front();
+        }
+        guard.unlock();
+        dropped.clear();
+        if (walking) {
+            vector<inode_id> stack {work.dir};
+            while (not stack.empty()) {
+                inode_id nr = stack.back();
+                stack.pop_back();
+                work.numbers.push_back(nr);
+                const inode& node = work.table.at(nr);
+                if (node.get_type() == DIR_INODE)
+                    node.dir().children(stack);
+            }
+        }
+        guard.lock();
+        if (walking) {
+            walked.push_back(move(work));
+            if (--unwalked == 0)
+                walked_all.notify_all();
+        }
     }
 }
 
 inode_state::inode_state() {
-    root = make_shared<inode>(DIR_INODE);
+    root = table.allocate(DIR_INODE);
     cwd = root;
-    directory_ptr_of(root->contents)->set_root(root);
+    edit_dir(root).set_root(table, root);
    DEBUGF ('i', "root = " << root << ", cwd = " << cwd
           << ", prompt = \"" << prompt << "\"");
 }
 
-inode_ptr inode_state::resolve_pathname(const string& pathname) {
-    inode_ptr p;
+size_t dentry_cache::dentry_hash::operator() (
+                            const pair<int,string>& key) const {
+    return hash<string>()(key.second) * 31 + key.first;
+}
+
+inode_id dentry_cache::lookup (inode_id parent,
+                               const string& name) const {
+    auto it = dentries.find(make_pair(parent, name));
+    return it == dentries.end() ? NO_INODE : it->second;
+}
+
+void dentry_cache::insert (inode_id parent, const string& name,
+                           inode_id dir) {
+    dentries[make_pair(parent, name)] = dir;
+}
+
+inode_id dentry_cache::lookup_path (const string& prefix) const {
+    auto it = paths.find(prefix);
+    return it == paths.end() ? NO_INODE : it->second;
+}
+
+void dentry_cache::insert_path (const string& prefix, inode_id dir) {
+    paths[prefix] = dir;
+}
+
+void dentry_cache::clear() {
+    DEBUGF ('i', "dentries: " << dentries.size()
+                 << ", paths: " << paths.size());
+    dentries.clear();
+    paths.clear();
+}
+
+void name_index::invalidate() {
+    valid = false;
+}
+
+void name_index::clear() {
+    names.clear();
+    valid = true;
+}
+
+void name_index::insert (const string& name, inode_id nr,
+                         inode_id parent) {
+    if (valid)
+        names[make_pair(name, nr)] = parent;
+}
+
+void name_index::erase (const string& name, inode_id nr) {
+    if (valid)
+        names.erase(make_pair(name, nr));
+}
+
+inode_id name_index::parent (const string& name,
+                             inode_id nr) const {
+    auto it = names.find(make_pair(name, nr));
+    return it == names.end() ? NO_INODE : it->second;
+}
+
+void name_index::find (const string& pattern,
+                       vector<match>& matches) const {
+    size_t wild = pattern.find_first_of("*?[\\");
+    string prefix = pattern.substr(0, wild);
+    bool prefix_only = wild != string::npos
+                       && wild == pattern.size() - 1
+                       && pattern[wild] == '*';
+    for (auto it = names.lower_bound(make_pair(prefix, INT_MIN));
+         it != names.end(); ++it) {
+        const string& name = it->first.first;
+        if (name.compare(0, prefix.size(), prefix) != 0)
+            break;
+        if (wild == string::npos && name.size() != prefix.size())
+            break;
+        if (wild != string::npos && not prefix_only
+            && fnmatch(pattern.c_str(), name.c_str(), 0) != 0)
+            continue;
+        matches.push_back(match {it->first.second, it->second});
+    }
+}
+
+void word_index::invalidate() {
+    valid = false;
+}
+
+void word_index::clear() {
+    words.clear();
+    parents.clear();
+    valid = true;
+}
+
+void word_index::add (inode_id nr, inode_id parent,
+                      const plain_file& file) {
+    if (not valid)
+        return;
+    parents[nr] = parent;
+    for (size_t i = 0; i < file.word_count(); ++i)
+        words[file.word(i)][nr].push_back(i);
+}
+
+void word_index::remove (inode_id nr, const plain_file& file) {
+    if (not valid)
+        return;
+    parents.erase(nr);
+    for (size_t i = 0; i < file.word_count(); ++i) {
+        auto it = words.find(file.word(i));
+        if (it == words.end())
+            continue;
+        it->second.erase(nr);
+        if (it->second.empty())
+            words.erase(it);
+    }
+}
+
+inode_id word_index::parent (inode_id nr) const {
+    auto it = parents.find(nr);
+    return it == parents.end() ? NO_INODE : it->second;
+}
+
+void word_index::find (const wordvec& query,
+                       vector<match>& matches) const {
+    vector<const postings*> lists;
+    for (const string& word: query) {
+        auto it = words.find(word);
+        if (it == words.end())
+            return;
+        lists.push_back(&it->second);
+    }
+    if (lists.empty())
+        return;
+    sort(lists.begin(), lists.end(),
+         [](const postings* left, const postings* right) {
+             return left->size() < right->size();
+         });
+    for (const auto& file: *lists.front()) {
+        bool all = true;
+        for (size_t i = 1; all && i < lists.size(); ++i)
+            all = lists[i]->count(file.first) != 0;
+        if (all)
+            matches.push_back(match {file.first,
+                                     parents.at(file.first)});
+    }
+}
+
+// Returns the directory named by everything before the last '/' of
+// the pathname, or NO_INODE if some component does not exist.
+// Each directory looked in, and the one returned, is read from the
+// host first if it was imported.
+// Absolute prefixes are looked up whole in the dentry cache first,
+// then each component is.
+inode_id inode_state::resolve_pathname(const string& pathname) {
+    inode_id p;
     size_t from = 0, found = 0;
-    if (pathname.at(0) == '/') {
+    size_t last = pathname.find_last_of("/");
+    bool absolute = pathname.at(0) == '/';
+    if (absolute) {
+        if (last != 0 && last != string::npos) {
+            p = dcache.lookup_path(pathname.substr(0, last + 1));
+            if (p != NO_INODE) {
+                read_dir(p);
+                return p;
+            }
+        }
         p = root;
         from = 1;
     } else {
         p = cwd;
     }
-    directory_ptr dir;
+    inode_id next;
     while (true) {
         found = pathname.find_first_of("/", from);
         DEBUGF ('i', "pathname: \"" << pathname 
@@ -298,18 +989,28 @@ inode_ptr inode_state::resolve_pathname(const string& pathname) {
         if (found == string::npos) {
             break;
         }
-        dir = directory_ptr_of(p->get_contents());
-        p = dir->lookup(pathname.substr(from, found - from));
-        if (p == nullptr)
-            return p;
+        string component = pathname.substr(from, found - from);
+        next = dcache.lookup(p, component);
+        if (next == NO_INODE) {
+            read_dir(p);
+            next = dir_of(p).lookup(component);
+            if (next == NO_INODE)
+                return next;
+            if (table.at(next).get_type() == DIR_INODE)
+                dcache.insert(p, component, next);
+        }
+        p = next;
         from = found + 1;
     }
+    if (absolute && last != 0 && table.at(p).get_type() == DIR_INODE)
+        dcache.insert_path(pathname.substr(0, last + 1), p);
+    read_dir(p);
     return p;
 }
 
 void inode_state::cat(const string& pathname, ostream& out) {
-    inode_ptr p = resolve_pathname(pathname);
-    if (p == nullptr)
+    inode_id p = resolve_pathname(pathname);
+    if (p == NO_INODE)
         throw yshell_exn("cat: " + pathname + "No such file");
     string name;
     size_t found = pathname.find_last_of("/");
@@ -317,111 +1018,273 @@ void inode_state::cat(const string& pathname, ostream& out) {
         name = pathname;
     else
         name = pathname.substr(found + 1);
-    wordvec data = directory_ptr_of(p->contents)->cat(name, pathname);
-    if (data.size() > 0)
-        out << data << endl;
+    inode_id file = dir_of(p).lookup(name);
+    if (file != NO_INODE && table.at(file).get_type() == PLAIN_INODE)
+        read_file(file, p);
+    const string& data = dir_of(p).cat(table, name, pathname);
+    if (data.size() > 0) {
+        out.write(data.data(), data.size());
+        out << endl;
+    }
 }
 
 void inode_state::cd() {
     cwd = root;
+    cwd_path.clear();
 }
 
 void inode_state::cd(const string& pathname) {
-    inode_ptr p;
+    inode_id p;
     if (pathname.back() != '/')
         p = resolve_pathname(pathname + '/');
     else
         p = resolve_pathname(pathname);
-    if (p == nullptr)
+    if (p == NO_INODE)
         throw yshell_exn("cd: " + pathname +
                          "No such directory");
+    if (table.at(p).get_type() != DIR_INODE)
+        throw yshell_exn("cd: " + pathname + ": Not a directory");
     cwd = p;
+    cwd_path = path_of(p);
 }
 
 void inode_state::ls(ostream& out) {
-    out << ".:" << endl;
-    directory_ptr dir = directory_ptr_of(cwd->contents);
-    dir->ls(out);
+    read_dir(cwd);
+    string buffer = ".:\n";
+    dir_of(cwd).ls(table, buffer);
+    flush_listing(buffer, out);
 }
 
 void inode_state::ls(const string& pathname, ostream& out) {
-    inode_ptr p = resolve_pathname(pathname);
-    if (p == nullptr)
+    inode_id p = resolve_pathname(pathname);
+    if (p == NO_INODE)
         throw yshell_exn ("ls: " + pathname +
                          ": No such file or directory");
+    string buffer;
     if (pathname.back() != '/' || pathname == "/")
-        out << pathname << ":" << endl;
-    else 
-        out << pathname.substr(0, pathname.size() - 1) << ":" << endl;
-    if (p->get_type() == PLAIN_INODE) {
-        out << setw(6) << p->get_inode_nr()
-            << setw(6) << p->size()
-            << "\t" << pathname << endl;
+        buffer += pathname;
+    else
+        buffer.append(pathname, 0, pathname.size() - 1);
+    buffer += ":\n";
+    if (table.at(p).get_type() == PLAIN_INODE) {
+        append_dirent(buffer, table.at(p), pathname, "");
+        flush_listing(buffer, out);
         return;
     }
-    directory_ptr dir = directory_ptr_of(p->contents);
     if (pathname.back() != '/') {
         size_t found = pathname.find_last_of("/");
         if (found == string::npos)
-            p = dir->lookup(pathname);
+            p = dir_of(p).lookup(pathname);
         else
-            p = dir->lookup(pathname.substr(found+1));
-        if (p == nullptr) {
+            p = dir_of(p).lookup(pathname.substr(found+1));
+        if (p == NO_INODE) {
             throw yshell_exn ("ls: " + pathname +
                              ": No such file or directory");
         }
-        dir = directory_ptr_of(p->contents);
+        read_dir(p);
     }
-    dir->ls(out);
+    flush_listing(buffer, out);
+    dir_of(p).ls(table, buffer);
+    flush_listing(buffer, out);
 }
 
 void inode_state::lsr(ostream& out) {
-    ls(out);
-    directory_ptr dir = directory_ptr_of(cwd->contents);
-    vector<inode_ptr> subdirs (dir->subdirs());
-    for (size_t i = 0;
-                i < subdirs.size();
-                i++)
-        lsr("./" + subdirs.at(i)->get_name() + "/", out);
+    lsr(".", out);
 }
 
-void inode_state::lsr(const string& pathname, ostream& out) {
-    string suffix;
-    inode_ptr p; 
-    if (pathname.back() == '/')
-        suffix = "";
+// Appends the header and listing of one directory, whose path
+// ends in a slash.
+static void list_directory(const inode_table& table, inode_id dir,
+                           const string& path, string& buffer) {
+    if (path == "/")
+        buffer += path;
     else
-        suffix = "/";
-    p = resolve_pathname(pathname + suffix);
-    if (p == nullptr)
+        buffer.append(path, 0, path.size() - 1);
+    buffer += ":\n";
+    table.at(dir).dir().ls(table, buffer);
+}
+
+// Lists the directory and then, depth first in name order, every
+// directory below it.  The walk keeps its own stack of directories
+// with how far through each one's entries it has got, and builds
+// each path in one buffer by truncating back to the parent's path
+// and appending the next name.  With an ostream the buffer is
+// written out as it fills, otherwise it holds the whole listing.
+static void list_subtree(const inode_table& table, inode_id dir,
+                         string path, string& buffer, ostream* out) {
+    struct frame {
+        const vector<const dirent*>* entries;
+        size_t next;
+        size_t path_length;
+    };
+    vector<frame> stack;
+    for (inode_id p = dir; p != NO_INODE; ) {
+        list_directory(table, p, path, buffer);
+        if (out != nullptr && buffer.size() >= LISTING_FLUSH_SIZE)
+            flush_listing(buffer, *out);
+        stack.push_back(frame {&table.at(p).dir().entries(), 0,
+                               path.size()});
+
+        // Find the next subdirectory to list, popping exhausted
+        // directories off the stack.
+        p = NO_INODE;
+        while (p == NO_INODE && not stack.empty()) {
+            frame& top = stack.back();
+            while (top.next < top.entries->size()) {
+                const dirent* ent = (*top.entries)[top.next++];
+                if (ent->name != "." && ent->name != ".."
+                    && table.at(ent->value).get_type() == DIR_INODE) {
+                    p = ent->value;
+                    path.resize(top.path_length);
+                    path += ent->name;
+                    path += '/';
+                    break;
+                }
+            }
+            if (p == NO_INODE)
+                stack.pop_back();
+        }
+    }
+}
+
+//
+// lsr_task -
+//    One piece of a parallel lsr:  a directory listed on its own,
+//    or listed together with everything below it.  Concatenating
+//    the output of the tasks in order gives the sequential listing.
+//
+
+struct lsr_task {
+    inode_id dir;
+    string path;
+    bool subtree;
+    string output;
+    bool done;
+};
+
+static constexpr int LSR_SPLIT_ROUNDS = 4;
+static constexpr size_t LSR_TASKS_PER_WORKER = 8;
+
+// Below this many inodes, listing a tree takes about as long as
+// starting the workers, so it is listed on this thread.
+static constexpr size_t LSR_PARALLEL_INODES = 4096;
+
+// Splits the walk from p into ordered tasks.  Each round replaces
+// every subtree task by a task for its own listing followed by a
+// subtree task per subdirectory, until there are enough subtrees
+// to keep the workers busy or nothing is left to split.
+static vector<lsr_task> split_lsr(const inode_table& table,
+                                  inode_id p, const string& path,
+                                  size_t wanted) {
+    vector<lsr_task> tasks;
+    tasks.push_back(lsr_task {p, path, true, "", false});
+    for (int round = 0; round < LSR_SPLIT_ROUNDS; ++round) {
+        vector<lsr_task> split;
+        size_t subtrees = 0;
+        for (lsr_task& task: tasks) {
+            if (not task.subtree) {
+                split.push_back(move(task));
+                continue;
+            }
+            split.push_back(lsr_task {task.dir, task.path, false,
+                                      "", false});
+            for (auto ent: table.at(task.dir).dir().entries()) {
+                if (ent->name == "." || ent->name == ".."
+                    || table.at(ent->value).get_type() != DIR_INODE)
+                    continue;
+                split.push_back(lsr_task {ent->value,
+                                task.path + ent->name + "/", true,
+                                "", false});
+                ++subtrees;
+            }
+        }
+        tasks.swap(split);
+        if (subtrees == 0 || subtrees >= wanted)
+            break;
+    }
+    return tasks;
+}
+
+// Trees of LSR_PARALLEL_INODES or more, as counted by the totals
+// kept in each directory, are listed by a pool of workers, and
+// smaller ones without starting any threads.  The tree is not
+// changed during the walk and every directory is listed by exactly
+// one task, so the workers share the table without locking.  The
+// workers claim tasks in order from a shared counter, which lets an
+// idle worker take on whatever is left however unevenly the tree
+// is divided, while this thread writes each task's output as soon
+// as it and every task before it are done.  A directory still in
+// an image is filled in by the one task that lists it; its parent
+// only asks it for its size, which needs no filling in.
+void inode_state::lsr(const string& pathname, ostream& out) {
+    string path = pathname;
+    if (path.back() != '/')
+        path += '/';
+    inode_id p = resolve_pathname(path);
+    if (p == NO_INODE)
         throw yshell_exn ("lsr: " + pathname +
                          ": No such file or directory");
-    ls(pathname, out);
-    directory_ptr dir = directory_ptr_of(p->contents);
-    vector<inode_ptr> subdirs (dir->subdirs());
-    for (size_t i = 0;
-                i < subdirs.size();
-                i++)
-        lsr(pathname + suffix + subdirs.at(i)->get_name() + '/', out);
+    if (table.at(p).get_type() != DIR_INODE)
+        throw yshell_exn ("lsr: " + pathname + ": Not a directory");
+    read_below(p, false);
+
+    size_t workers = thread::hardware_concurrency();
+    vector<lsr_task> tasks;
+    if (workers > 1 && dir_of(p).tree_inodes() >= LSR_PARALLEL_INODES)
+        tasks = split_lsr(table, p, path,
+                          workers * LSR_TASKS_PER_WORKER);
+    if (tasks.size() < 2) {
+        string buffer;
+        list_subtree(table, p, path, buffer, &out);
+        flush_listing(buffer, out);
+        return;
+    }
+
+    atomic<size_t> next_task {0};
+    mutex done_lock;
+    condition_variable done_signal;
+    auto work = [&]() {
+        for (;;) {
+            size_t index = next_task++;
+            if (index >= tasks.size())
+                return;
+            lsr_task& task = tasks[index];
+            if (task.subtree)
+                list_subtree(table, task.dir, task.path,
+                             task.output, nullptr);
+            else
+                list_directory(table, task.dir, task.path,
+                               task.output);
+            lock_guard<mutex> guard(done_lock);
+            task.done = true;
+            done_signal.notify_all();
+        }
+    };
+    vector<thread> pool;
+    for (size_t count = min(workers, tasks.size()); count > 0; --count)
+        pool.emplace_back(work);
+    for (lsr_task& task: tasks) {
+        {
+            unique_lock<mutex> guard(done_lock);
+            done_signal.wait(guard, [&]() { return task.done; });
+        }
+        flush_listing(task.output, out);
+        task.output.shrink_to_fit();
+    }
+    for (thread& worker: pool)
+        worker.join();
 }
 
 void inode_state::make(const string& pathname) {
-    inode_ptr p = resolve_pathname(pathname);
-    if (p == nullptr)
-        throw yshell_exn ("make: " + pathname + 
-                            ": invalid path");
-    string name;
-    size_t found = pathname.find_last_of("/");
-    if (found == string::npos)
-        name = pathname;
-    else
-        name = pathname.substr(found + 1);
-    directory_ptr_of(p->contents)->make(name, pathname);
+    spanvec none;
+    make(pathname, none.begin(), none.end());
 }
 
-void inode_state::make(const string& pathname, wordvec& data) {
-    inode_ptr p = resolve_pathname(pathname);
-    if (p == nullptr)
+void inode_state::make(const string& pathname,
+                       span_iter first, span_iter last) {
+    release_removed();
+    inode_id p = resolve_pathname(pathname);
+    if (p == NO_INODE)
         throw yshell_exn ("make: " + pathname + 
                             ": invalid path");
     string name;
@@ -430,87 +1293,219 @@ void inode_state::make(const string& pathname, wordvec& data) {
         name = pathname;
     else
         name = pathname.substr(found + 1);
-    directory_ptr_of(p->contents)->make(name, pathname, data);
+    // Rewriting a file leaves its directory as it is.
+    inode_id file = dir_of(p).lookup(name);
+    if (file != NO_INODE && table.at(file).get_type() == PLAIN_INODE) {
+        contents.remove(file, table.at(file).file());
+        ptrdiff_t old_size = table.at(file).size();
+        ptrdiff_t unread = table.at(file).file().host_path().empty()
+                         ? 0 : 1;
+        table.edit(file).file().writefile(first, last);
+        update_totals(p, table.at(file).size() - old_size, 0, -unread);
+    } else {
+        edit_dir(p).make(table, name, pathname, first, last);
+        file = dir_of(p).lookup(name);
+        names.insert(name, file, p);
+        update_totals(p, table.at(file).size(), 1);
+    }
+    contents.add(file, p, table.at(file).file());
+    log("make", pathname, first, last);
 }
 
 void inode_state::mkdir(const string& pathname) {
+    release_removed();
     string name;
     if (pathname.back() == '/')
         name = pathname.substr(0, pathname.size() - 1);
-    else 
+    else
         name = pathname;
-    inode_ptr p = resolve_pathname(name);
-    if (p == nullptr)
+    inode_id p = resolve_pathname(name);
+    if (p == NO_INODE)
         throw yshell_exn ("mkdir: " + pathname + 
                             ": invalid path");
-    directory_ptr dir = directory_ptr_of(p->get_contents());
     size_t found = name.find_last_of("/");
-    if (found == string::npos)
-        dir->mkdir(name);
+    if (found != string::npos)
+        name = name.substr(found+1);
+    names.insert(name, edit_dir(p).mkdir(table, name), p);
+    update_totals(p, 0, 1);
+    spanvec none;
+    log("mkdir", pathname, none.begin(), none.end());
+}
+
+// The host path is made absolute, so that the journal record of
+// the import means the same whatever directory yshell runs in.
+void inode_state::import(const string& pathname, const string& host) {
+    release_removed();
+    string source = host_directory(host);
+    string name;
+    if (pathname.back() == '/')
+        name = pathname.substr(0, pathname.size() - 1);
     else
-        dir->mkdir(name.substr(found+1));
+        name = pathname;
+    inode_id p = resolve_pathname(name);
+    if (p == NO_INODE)
+        throw yshell_exn ("import: " + pathname + ": invalid path");
+    size_t found = name.find_last_of("/");
+    if (found != string::npos)
+        name = name.substr(found+1);
+    if (dir_of(p).lookup(name) != NO_INODE)
+        throw yshell_exn ("import: " + pathname + ": exists");
+    inode_id dir = edit_dir(p).mkdir(table, name);
+    edit_dir(dir).import(source);
+    edit_dir(dir).add_below(0, 0, 1);
+    names.insert(name, dir, p);
+    update_totals(p, 0, 1, 1);
+    spanvec words {word_span {source.data(), source.size()}};
+    log("import", pathname, words.begin(), words.end());
+}
+
+// Makes a directory and a file for each entry of an imported
+// directory, each of them imported in turn, and counts them as
+// still to be read in place of the directory itself.  A host
+// directory that cannot be read is complained of and taken as
+// empty, so that it is read, and fails, only once.
+void inode_state::read_dir(inode_id dir) {
+    if (table.at(dir).get_type() != DIR_INODE
+        || dir_of(dir).host_path().empty())
+        return;
+    release_removed();
+    string host = dir_of(dir).host_path();
+    vector<host_entry> entries;
+    try {
+        entries = read_host_dir(host);
+    }catch (yshell_exn& exn) {
+        complain() << exn.what() << endl;
+    }
+    if (host.back() != '/')
+        host += '/';
+    ptrdiff_t bytes = 0;
+    for (const host_entry& ent: entries) {
+        inode_id nr;
+        if (ent.is_dir) {
+            nr = edit_dir(dir).mkdir(table, ent.name);
+            edit_dir(nr).import(host + ent.name);
+            edit_dir(nr).add_below(0, 0, 1);
+        } else {
+            nr = edit_dir(dir).mkfile(table, ent.name);
+            table.edit(nr).file().import(host + ent.name, ent.size);
+            bytes += ent.size;
+        }
+        names.insert(ent.name, nr, dir);
+    }
+    edit_dir(dir).import("");
+    ptrdiff_t count = entries.size();
+    update_totals(dir, bytes, count, count - 1);
+}
+
+// The file's size changes from the host file's to that of its
+// words joined by single spaces.  A host file that cannot be read
+// is taken as empty, as is a directory.
+void inode_state::read_file(inode_id file, inode_id parent) {
+    const plain_file& unread = table.at(file).file();
+    if (unread.host_path().empty())
+        return;
+    ptrdiff_t old_size = unread.size();
+    try {
+        host_file host (unread.host_path());
+        table.edit(file).file().readwords(host.data(), host.size());
+    }catch (yshell_exn& exn) {
+        complain() << exn.what() << endl;
+        table.edit(file).file().readwords(nullptr, 0);
+    }
+    update_totals(parent, table.at(file).size() - old_size, 0, -1);
+    contents.add(file, parent, table.at(file).file());
+}
+
+// Reads every imported directory from dir down, and every imported
+// file too if files is true, walking only the directories with
+// something below them still to be read.  Each file read is added
+// to the word index as it is read.
+void inode_state::read_below(inode_id dir, bool files) {
+    vector<inode_id> stack {dir};
+    vector<inode_id> numbers;
+    while (not stack.empty()) {
+        inode_id p = stack.back();
+        stack.pop_back();
+        if (dir_of(p).tree_unread() == 0)
+            continue;
+        read_dir(p);
+        numbers.clear();
+        dir_of(p).children(numbers);
+        for (inode_id nr: numbers) {
+            if (table.at(nr).get_type() == DIR_INODE)
+                stack.push_back(nr);
+            else if (files)
+                read_file(nr, p);
+        }
+    }
 }
 
 string inode_state::get_prompt () const {
     return prompt;
 }
 
-void inode_state::set_prompt(const wordvec& words) {
+void inode_state::set_prompt(const spanvec& words) {
     if (words.size() == 1)
         prompt = "% ";
     else {
         prompt = "";
         for (size_t i = 1;
                 i < words.size();
-                i++)
-            prompt += words.at(i) + " ";
+                i++) {
+            prompt.append(words[i].data, words[i].size);
+            prompt += ' ';
+        }
     }
 }
 
 void inode_state::pwd(ostream& out) {
-    wordvec name_stack;
-    inode_ptr p = cwd;
-    directory_ptr dp;
-    while (p != root) {
-        name_stack.push_back(p->name);
-        dp = directory_ptr_of(p->contents);
-        p  = dp->lookup("..");
-    }
-    if (name_stack.size() == 0) {
+    if (cwd_path.empty())
         out << '/' << endl;
-        return;
-    }
-    while (name_stack.size() > 0) {
-        out << '/';
-        out << name_stack.back();
-        name_stack.pop_back();
-    }
-    out << endl;
+    else
+        out << cwd_path << endl;
 }
 
 void inode_state::rm(const string& pathname) {
     string target_name, pname;
-    bool is_dir;
+    bool is_dir = false;
     if (pathname.back() == '/') {
         pname = pathname.substr(0, pathname.size() - 1);
         is_dir = true;
     } else { 
         pname = pathname;
     }
-    inode_ptr p = resolve_pathname(pname);
+    inode_id parent = resolve_pathname(pname);
     size_t found = pname.find_last_of("/");
     if (found == string::npos)
         target_name = pname;
     else
         target_name = pathname.substr(found + 1);
-    directory_ptr dir = directory_ptr_of(p->contents);
-    p = dir->lookup(target_name);
-    if (p == nullptr)
+    inode_id p = NO_INODE;
+    if (parent != NO_INODE)
+        p = dir_of(parent).lookup(target_name);
+    if (p == NO_INODE)
         throw yshell_exn ("rm: " + pathname 
                 + ": No such file or directory");
-    if (p->type == PLAIN_INODE && is_dir)
+    inode_t type = table.at(p).type;
+    if (type == PLAIN_INODE && is_dir)
         throw yshell_exn ("rm: " + pathname + ": is not a directory");
-    dir->remove(target_name, pathname);
+    ptrdiff_t unread = 0;
+    if (type == PLAIN_INODE) {
+        contents.remove(p, table.at(p).file());
+        unread = table.at(p).file().host_path().empty() ? 0 : 1;
+    } else {
+        read_dir(p);
+    }
+    ptrdiff_t bytes = type == PLAIN_INODE ? table.at(p).size() : 0;
+    edit_dir(parent).remove(table, target_name, pathname);
+    update_totals(parent, -bytes, -1, -unread);
+    names.erase(target_name, p);
+    spanvec none;
+    log("rm", pathname, none.begin(), none.end());
+    if (type == DIR_INODE) {
+        dcache.clear();
+        set_cwd(cwd, cwd_path);
+    }
 }
 
 void inode_state::rmr(const string& pathname) {
@@ -520,25 +1515,625 @@ void inode_state::rmr(const string& pathname) {
     } else { 
         pname = pathname;
     }
-    inode_ptr p = resolve_pathname(pname);
     size_t found = pname.find_last_of("/");
     if (found == string::npos)
         target_name = pname;
     else
-        target_name = pathname.substr(found + 1);
-    directory_ptr dir = directory_ptr_of(p->contents);
-    p = dir->lookup(target_name);
-    if (p == nullptr)
+        target_name = pname.substr(found + 1);
+    if (target_name.empty() || target_name == "."
+        || target_name == "..")
+        throw yshell_exn ("rmr: " + pathname
+                + ": cannot remove /, . or ..");
+    inode_id parent = resolve_pathname(pname);
+    inode_id p = NO_INODE;
+    if (parent != NO_INODE)
+        p = dir_of(parent).lookup(target_name);
+    if (p == NO_INODE)
         throw yshell_exn ("rmr: " + pathname 
                 + ": No such file or directory");
-    if (p->type == PLAIN_INODE)
+    if (table.at(p).type == PLAIN_INODE)
         throw yshell_exn ("rmr: " + pathname + ": is not a directory");
-    dir->remove_r(target_name, pathname);
+    if (above_cwd(p))
+        throw yshell_exn ("rmr: " + pathname
+                + ": contains the working directory");
+    const directory& dir = dir_of(p);
+    ptrdiff_t bytes = dir.tree_bytes();
+    ptrdiff_t inodes = dir.tree_inodes() + 1;
+    ptrdiff_t unread = dir.tree_unread();
+    names.erase(target_name, p);
+    edit_dir(parent).remove_r(target_name, pathname);
+    edit_dir(p).unlink_parent();
+    update_totals(parent, -bytes, -inodes, -unread);
+    reclaim.detach(table, p);
+    dcache.clear();
+    spanvec none;
+    log("rmr", pathname, none.begin(), none.end());
+    set_cwd(cwd, cwd_path);
+}
+
+// Writes the tree breadth first, so that each directory's record
+// exists before its dirents are reached and can be filled in then.
+void inode_state::save(const string& filename) {
+    release_removed();
+    image_writer image;
+    image.header.root = root;
+    image.header.log_sequence = wal.last();
+    image.header.next_nr = table.next_number();
+    for (inode_id nr: table.free_numbers())
+        image.free_nrs.push_back(nr);
+    const string& root_name = table.at(root).name;
+    image.inodes.push_back(image_inode {image.add_name(root_name),
+                           0, 0, uint32_t (root_name.size()),
+                           uint32_t (root), DIR_INODE, 0});
+    // Files that share a blob share its bytes in the image too.
+    unordered_map<const string*,uint64_t> data_at;
+    for (size_t index = 0; index < image.inodes.size(); ++index) {
+        if (image.inodes[index].type != DIR_INODE)
+            continue;
+        const directory& dir = table.at(image.inodes[index].nr).dir();
+        image.inodes[index].first = image.dirents.size();
+        image.inodes[index].count = dir.size();
+        for (auto ent: dir.entries()) {
+            uint64_t name_offset = image.add_name(ent->name);
+            image.dirents.push_back(image_dirent {name_offset,
+                                    uint32_t (ent->name.size()),
+                                    uint32_t (ent->value)});
+            if (ent->name == "." || ent->name == "..")
+                continue;
+            const inode& node = table.at(ent->value);
+            const string& host = node.type == PLAIN_INODE
+                                 ? node.file().host_path()
+                                 : node.dir().host_path();
+            if (not host.empty())
+                name_offset = image.add_name(node.name + host);
+            else if (node.name != ent->name)
+                name_offset = image.add_name(node.name);
+            image_inode record {name_offset, 0, 0,
+                                uint32_t (node.name.size()),
+                                uint32_t (node.inode_nr),
+                                uint32_t (node.type),
+                                uint32_t (host.size())};
+            if (node.type == PLAIN_INODE && not host.empty()) {
+                record.count = node.size();
+            } else if (node.type == PLAIN_INODE) {
+                const string& bytes = node.file().readfile();
+                auto stored = data_at.emplace(&bytes, 0);
+                if (stored.second)
+                    stored.first->second = image.add_data(bytes);
+                record.first = stored.first->second;
+                record.count = node.size();
+            }
+            image.inodes.push_back(record);
+        }
+    }
+    image.write(filename);
+}
+
+// Builds a new table from the image, checking every record as it
+// goes so that a bad image leaves the current tree untouched.  The
+// directories are left to fill themselves in from the image.
+void inode_state::load(const string& filename) {
+    load_image(filename);
+    if (journaling)
+        checkpoint();
+}
+
+uint64_t inode_state::load_image(const string& filename) {
+    auto image = make_shared<const fs_image>(filename);
+    const image_header& head = image->header();
+    yshell_exn corrupt ("load: " + filename + ": corrupt image");
+    if (head.next_nr < 1 || head.next_nr > uint32_t (INT_MAX))
+        throw corrupt;
+    inode_table fresh;
+    vector<bool> present(head.next_nr);
+    for (uint64_t i = 0; i < head.inode_count; ++i) {
+        const image_inode& record = image->inode(i);
+        if (record.nr == NO_INODE || record.nr >= head.next_nr
+            || present[record.nr]
+            || not image->has_name(record.name_offset,
+                                   uint64_t (record.name_length)
+                                   + record.host_length))
+            throw corrupt;
+        switch (record.type) {
+            case PLAIN_INODE:
+                if (record.host_length == 0
+                    && not image->has_data(record.first, record.count))
+                    throw corrupt;
+                break;
+            case DIR_INODE:
+                if (record.first > head.dirent_count
+                    || record.count > head.dirent_count - record.first)
+                    throw corrupt;
+                break;
+            default:
+                throw corrupt;
+        }
+        present[record.nr] = true;
+        fresh.allocate_at(record.nr, inode_t (record.type));
+        inode& node = fresh.edit(record.nr);
+        node.name.assign(image->name(record.name_offset),
+                         record.name_length);
+        string host (image->name(record.name_offset)
+                     + record.name_length, record.host_length);
+        if (record.type == DIR_INODE) {
+            node.dir_contents.defer(image, record.first, record.count);
+            node.dir_contents.import(host);
+        } else if (host.empty()) {
+            node.file_contents.writebytes(image->data(record.first),
+                                          record.count);
+        } else {
+            node.file_contents.import(host, record.count);
+        }
+    }
+    for (uint64_t i = 0; i < head.dirent_count; ++i) {
+        const image_dirent& ent = image->dirent(i);
+        if (ent.nr >= head.next_nr || not present[ent.nr]
+            || ent.name_length == 0
+            || not image->has_name(ent.name_offset, ent.name_length))
+            throw corrupt;
+    }
+    if (head.root >= head.next_nr || not present[head.root]
+        || fresh.at(head.root).type != DIR_INODE)
+        throw corrupt;
+
+    // Work out the totals below each directory from the leaves up,
+    // and take its parent from its dotdot.
+    // save writes the inodes breadth first, so in reverse order
+    // every directory comes after everything below it.  An image
+    // not in that order, or not a tree, is corrupt:  the walks up
+    // the tree by dotdot would never end on a cycle.
+    vector<uint64_t> bytes(head.next_nr);
+    vector<uint64_t> inodes(head.next_nr);
+    vector<uint64_t> unread(head.next_nr);
+    vector<inode_id> parents(head.next_nr, NO_INODE);
+    vector<bool> done(head.next_nr);
+    vector<bool> listed(head.next_nr);
+    auto is_dot = [](const char* name, uint32_t length) {
+        return (length == 1 || length == 2) && name[0] == '.'
+               && (length == 1 || name[1] == '.');
+    };
+    for (uint64_t i = head.inode_count; i-- > 0; ) {
+        const image_inode& record = image->inode(i);
+        done[record.nr] = true;
+        unread[record.nr] = record.host_length == 0 ? 0 : 1;
+        if (record.type == PLAIN_INODE) {
+            bytes[record.nr] = record.count;
+            continue;
+        }
+        bool dot = false;
+        inode_id parent = NO_INODE;
+        for (uint64_t k = 0; k < record.count; ++k) {
+            const image_dirent& ent = image->dirent(record.first + k);
+            if (is_dot(image->name(ent.name_offset), ent.name_length)) {
+                if (ent.name_length == 1) {
+                    if (dot || ent.nr != record.nr)
+                        throw corrupt;
+                    dot = true;
+                } else {
+                    if (parent != NO_INODE)
+                        throw corrupt;
+                    parent = ent.nr;
+                }
+                continue;
+            }
+            if (not done[ent.nr] || listed[ent.nr]
+                || (fresh.at(ent.nr).type == DIR_INODE
+                    && parents[ent.nr] != inode_id (record.nr)))
+                throw corrupt;
+            listed[ent.nr] = true;
+            bytes[record.nr] += bytes[ent.nr];
+            inodes[record.nr] += 1 + inodes[ent.nr];
+            unread[record.nr] += unread[ent.nr];
+        }
+        if (not dot || parent == NO_INODE
+            || fresh.at(parent).type != DIR_INODE)
+            throw corrupt;
+        parents[record.nr] = parent;
+        directory& dir = fresh.edit(record.nr).dir_contents;
+        dir.add_below(bytes[record.nr], inodes[record.nr],
+                      unread[record.nr]);
+        dir.set_parent(parent);
+    }
+    if (parents[head.root] != inode_id (head.root)
+        || listed[head.root])
+        throw corrupt;
+    for (inode_id nr = 1; nr < inode_id (head.next_nr); ++nr)
+        if (present[nr] && nr != inode_id (head.root) && not listed[nr])
+            throw corrupt;
+    vector<inode_id> free_nrs;
+    for (uint64_t i = 0; i < head.free_count; ++i) {
+        uint32_t nr = image->free_nr(i);
+        if (nr == NO_INODE || nr >= head.next_nr || present[nr])
+            throw corrupt;
+        free_nrs.push_back(nr);
+    }
+    fresh.set_numbers(head.next_nr, free_nrs);
+    release_removed();
+    reclaim.discard(move(table));
+    table = move(fresh);
+    root = cwd = head.root;
+    cwd_path.clear();
+    dcache.clear();
+    names.invalidate();
+    contents.invalidate();
+    return head.log_sequence;
+}
+
+// Every subtree removed is released first, so that no snapshot
+// holds numbers that are neither in use nor free.
+void inode_state::snapshot(const string& name) {
+    release_removed();
+    auto it = snapshots.find(name);
+    if (it != snapshots.end()) {
+        reclaim.discard(move(it->second.table));
+        snapshots.erase(it);
+    }
+    snapshots.emplace(name, snapshot_t {table, root, cwd, cwd_path});
+}
+
+void inode_state::restore(const string& name) {
+    auto it = snapshots.find(name);
+    if (it == snapshots.end())
+        throw yshell_exn ("restore: " + name + ": No such snapshot");
+    release_removed();
+    inode_table before = move(table);
+    inode_id before_root = root;
+    table = it->second.table;
+    root = it->second.root;
+    cwd = it->second.cwd;
+    cwd_path = it->second.cwd_path;
+    dcache.clear();
+    reindex(before, before_root);
+    reclaim.discard(move(before));
+    if (journaling)
+        checkpoint();
+}
+
+void inode_state::list_snapshots(ostream& out) const {
+    for (const auto& entry: snapshots)
+        out << entry.first << endl;
+}
+
+// Visits every directory from dir down, calling visit with each
+// dirent other than dot and dotdot and the directory it is in.
+template <typename visitor>
+static void walk_below(const inode_table& table, inode_id dir,
+                       visitor visit) {
+    vector<inode_id> stack {dir};
+    while (not stack.empty()) {
+        inode_id p = stack.back();
+        stack.pop_back();
+        for (auto ent: table.at(p).dir().entries()) {
+            if (ent->name == "." || ent->name == "..")
+                continue;
+            visit(ent->name, ent->value, p);
+            if (table.at(ent->value).get_type() == DIR_INODE)
+                stack.push_back(ent->value);
+        }
+    }
+}
+
+void inode_state::build_names() {
+    names.clear();
+    walk_below(table, root,
+               [this](const string& name, inode_id nr, inode_id p) {
+                   names.insert(name, nr, p);
+               });
+}
+
+void inode_state::build_contents() {
+    contents.clear();
+    walk_below(table, root,
+               [this](const string&, inode_id nr, inode_id p) {
+                   const inode& node = table.at(nr);
+                   if (node.get_type() == PLAIN_INODE)
+                       contents.add(nr, p, node.file());
+               });
+}
+
+// Releases the inodes of the subtrees rmr took out of the tree,
+// taking their names and words out of the indexes as it goes.  So
+// the indexes cost rmr time only in the size of what it removed,
+// and spend it when the walk has found what that is.
+void inode_state::release_removed() {
+    reclaim.collect(table, [this](inode_id nr) {
+        const inode& gone = table.at(nr);
+        names.erase(gone.name, nr);
+        if (gone.type == PLAIN_INODE)
+            contents.remove(nr, gone.file());
+    });
+}
+
+// Brings the indexes from the tree of the table before to that of
+// the table now, looking only at the chunks the two do not share,
+// so that restoring a snapshot costs time in how much has changed
+// since.  Each name and file in those chunks is taken out as it
+// was and put back as it is, unless neither it nor its directory
+// changed.  A file does not know its directory, which is the
+// changed directory listing it, or if none does, the one it was in
+// before, since that directory's dirents, and so its files, did not
+// change.
+void inode_state::reindex(const inode_table& before,
+                          inode_id before_root) {
+    if (not names.is_valid() && not contents.is_valid())
+        return;
+    struct change {
+        const inode* now;
+        const inode* then;
+        inode_id parent;
+        bool same_name;
+        bool same_file;
+    };
+    vector<change> changes;
+    unordered_map<inode_id,inode_id> listed;
+    vector<inode_id> numbers;
+    table.compare(before, [&](const inode* now, const inode* then) {
+        if (now != nullptr && now->type == DIR_INODE
+            && (then == nullptr || then->type != DIR_INODE
+                || not now->dir().shares_dirents(then->dir()))) {
+            numbers.clear();
+            now->dir().children(numbers);
+            for (inode_id nr: numbers)
+                listed[nr] = now->inode_nr;
+        }
+        if (now != nullptr && now->inode_nr == root)
+            now = nullptr;
+        if (then != nullptr && then->inode_nr == before_root)
+            then = nullptr;
+        changes.push_back(change {now, then, NO_INODE, false, false});
+    });
+    for (change& each: changes) {
+        if (each.now == nullptr)
+            continue;
+        inode_id nr = each.now->inode_nr;
+        auto it = listed.find(nr);
+        if (each.now->type == DIR_INODE)
+            each.parent = each.now->dir().parent();
+        else if (it != listed.end())
+            each.parent = it->second;
+        else if (names.is_valid())
+            each.parent = names.parent(each.now->name, nr);
+        else
+            each.parent = contents.parent(nr);
+        if (each.then == nullptr)
+            continue;
+        each.same_name = each.then->name == each.now->name
+                && names.parent(each.then->name, nr) == each.parent;
+        each.same_file = each.then->type == PLAIN_INODE
+                && each.now->type == PLAIN_INODE
+                && each.now->file().shares(each.then->file())
+                && contents.parent(nr) == each.parent;
+    }
+    for (const change& each: changes) {
+        if (each.then == nullptr)
+            continue;
+        if (not each.same_name)
+            names.erase(each.then->name, each.then->inode_nr);
+        if (not each.same_file && each.then->type == PLAIN_INODE)
+            contents.remove(each.then->inode_nr, each.then->file());
+    }
+    for (const change& each: changes) {
+        if (each.now == nullptr)
+            continue;
+        if (not each.same_name)
+            names.insert(each.now->name, each.now->inode_nr,
+                         each.parent);
+        if (not each.same_file && each.now->type == PLAIN_INODE)
+            contents.add(each.now->inode_nr, each.parent,
+                         each.now->file());
+    }
+}
+
+// The path of a directory, found by following dotdot up to the
+// root.  The root's path is empty, so that a name can be appended
+// to any path after a slash.
+string inode_state::path_of(inode_id dir) const {
+    vector<const string*> parts;
+    for (inode_id p = dir; p != root; p = dir_of(p).parent())
+        parts.push_back(&table.at(p).name);
+    string path;
+    for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
+        path += '/';
+        path += **part;
+    }
+    return path;
+}
+
+void inode_state::find(const string& pattern, ostream& out) {
+    release_removed();
+    read_below(root, false);
+    if (not names.is_valid())
+        build_names();
+    vector<name_index::match> matches;
+    names.find(pattern, matches);
+    string buffer;
+    for (const auto& found: matches) {
+        buffer += path_of(found.second);
+        buffer += '/';
+        buffer += table.at(found.first).name;
+        buffer += '\n';
+    }
+    flush_listing(buffer, out);
+}
+
+void inode_state::grep(const wordvec& query, ostream& out) {
+    release_removed();
+    read_below(root, true);
+    if (not contents.is_valid())
+        build_contents();
+    vector<word_index::match> matches;
+    contents.find(query, matches);
+    vector<string> paths;
+    for (const auto& found: matches)
+        paths.push_back(path_of(found.second) + "/"
+                        + table.at(found.first).name);
+    sort(paths.begin(), paths.end());
+    string buffer;
+    for (const string& path: paths) {
+        buffer += path;
+        buffer += '\n';
+    }
+    flush_listing(buffer, out);
+}
+
+// Adds to the totals of the directory and every directory above.
+void inode_state::update_totals(inode_id dir, ptrdiff_t bytes,
+                                ptrdiff_t inodes, ptrdiff_t unread) {
+    for (inode_id p = dir; ; p = dir_of(p).parent()) {
+        edit_dir(p).add_below(bytes, inodes, unread);
+        if (p == root)
+            break;
+    }
+}
+
+void inode_state::du(const string& pathname, ostream& out) {
+    string path = pathname;
+    if (path.back() != '/')
+        path += '/';
+    inode_id p = resolve_pathname(path);
+    if (p == NO_INODE)
+        throw yshell_exn ("du: " + pathname +
+                         ": No such file or directory");
+    const inode& node = table.at(p);
+    size_t bytes = node.size();
+    size_t inodes = 0;
+    if (node.get_type() == DIR_INODE) {
+        bytes = node.dir().tree_bytes();
+        inodes = node.dir().tree_inodes();
+    }
+    char line[48];
+    int length = snprintf(line, sizeof line, "%10zu%10zu\t",
+                          bytes, inodes);
+    string buffer (line, length);
+    buffer += pathname;
+    buffer += '\n';
+    flush_listing(buffer, out);
+}
+
+// Every file is counted, including those only a snapshot holds,
+// since each would otherwise keep its own copy of its contents.
+void inode_state::stats(ostream& out) const {
+    blob_pool::totals sum = blob_pool::usage();
+    char lines[256];
+    int length = snprintf(lines, sizeof lines,
+                          "%10zu files with contents\n"
+                          "%10zu distinct contents\n"
+                          "%10zu bytes in files\n"
+                          "%10zu bytes stored\n"
+                          "%10zu bytes saved\n",
+                          sum.files, sum.blobs, sum.shared, sum.stored,
+                          sum.shared - sum.stored);
+    string buffer (lines, length);
+    flush_listing(buffer, out);
+}
+
+vector<string> inode_state::recover(const string& base) {
+    journal_base = base;
+    string image = base + ".img";
+    uint64_t after = 0;
+    if (access(image.c_str(), F_OK) == 0)
+        after = load_image(image);
+    return wal.open(base + ".log", after);
+}
+
+void inode_state::start_journal() {
+    journaling = wal.is_open();
+}
+
+void inode_state::commit() {
+    if (not journaling)
+        return;
+    wal.commit();
+    if (wal.size() >= journal::CHECKPOINT_SIZE)
+        checkpoint();
+}
+
+// The journal is committed before the image is written, and the
+// image is on the disk before the journal is emptied, so a crash
+// at any point leaves an image and a journal that recover the tree.
+// Records that are both in the image and the journal are skipped.
+void inode_state::checkpoint() {
+   DEBUGF ('j', "checkpoint at " << wal.last());
+    wal.commit();
+    save(journal_base + ".img");
+    wal.reset();
+}
+
+// Relative pathnames are logged from the root, since cd is not.
+void inode_state::log(const char* command, const string& pathname,
+                      span_iter first, span_iter last) {
+    if (not journaling)
+        return;
+    string record = command;
+    record += ' ';
+    if (pathname.front() != '/') {
+        record += cwd_path;
+        record += '/';
+    }
+    record += pathname;
+    for (; first != last; ++first) {
+        record += ' ';
+        record.append(first->data, first->size);
+    }
+    wal.append(record);
+}
+
+shared_ptr<const tree_version> inode_state::publish() {
+    return make_shared<const tree_version>
+           (tree_version {table, root, ++version});
+}
+
+// Inode numbers are reused, so the cached dentries and the indexes
+// may not describe the new tree.  Only sessions follow a version,
+// and find and grep run on the shared state, so a session's indexes
+// are never built again.
+void inode_state::follow(const tree_version& that) {
+    if (that.number == version)
+        return;
+    table = that.table;
+    root = that.root;
+    version = that.number;
+    set_cwd(cwd, cwd_path);
+    dcache.clear();
+    names.invalidate();
+    contents.invalidate();
+}
+
+// A number freed by rmr may since have been given to a directory
+// elsewhere.  No command moves a directory, so the path tells the
+// two apart.
+void inode_state::set_cwd(inode_id dir, const string& path) {
+    if (in_tree(dir) && path_of(dir) == path) {
+        cwd = dir;
+        cwd_path = path;
+    } else {
+        cwd = root;
+        cwd_path.clear();
+    }
+}
+
+// Whether the directory is the working directory or one of the
+// directories above it, root included.
+bool inode_state::above_cwd(inode_id dir) const {
+    for (inode_id p = cwd; p != root; p = dir_of(p).parent()) {
+        if (p == dir)
+            return true;
+    }
+    return dir == root;
+}
+
+bool inode_state::in_tree(inode_id dir) const {
+    for (inode_id p = dir; p != root; p = dir_of(p).parent()) {
+        if (p == NO_INODE || not table.in_use(p)
+            || table.at(p).get_type() != DIR_INODE)
+            return false;
+    }
+    return true;
 }
 
 void inode_state::terminate() {
-    directory_ptr dp = directory_ptr_of(root->contents);
-    dp->rec_empty();
+   DEBUGF ('i', "leaving the tree to exit");
+   reclaim.stop();
 }
 
 ostream& operator<< (ostream& out, const inode_state& state) {
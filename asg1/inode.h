@@ -6,13 +6,24 @@
 #ifndef __INODE_H__
 #define __INODE_H__
 
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
-#include <memory>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
+#include "dirmap.h"
+#include "journal.h"
 #include "util.h"
 
 //
@@ -21,136 +32,239 @@ using namespace std;
 //
 
 enum inode_t {PLAIN_INODE, DIR_INODE};
+class fs_image;
 class inode;
-class file_base;
-class plain_file;
-class directory;
-using inode_ptr = shared_ptr<inode>;
-using file_base_ptr = shared_ptr<file_base>;
-using plain_file_ptr = shared_ptr<plain_file>;
-using directory_ptr = shared_ptr<directory>;
+class inode_table;
 
 //
-// inode_state -
-//    A small convenient class to maintain the state of the simulated
-//    process:  the root (/), the current directory (.), and the
-//    prompt.
+// inode_id -
+//    Inodes refer to each other by inode number, which is also the
+//    inode's slot in the inode_table.  NO_INODE is never allocated.
 //
 
-class inode_state {
-   friend class inode;
-   friend ostream& operator<< (ostream& out, const inode_state&);
+using inode_id = int;
+constexpr inode_id NO_INODE = 0;
+
+//
+// dentry_cache -
+//    Remembers directory lookups so that deep paths are not walked
+//    one component at a time on every command.  Entries map a
+//    (parent inode number, component) pair, or a whole absolute
+//    directory prefix such as "/a/b/", onto the directory found.
+//    Only directories are cached and only successful lookups, so
+//    creating files or directories never makes an entry stale.
+//    Removing a directory does, and clears the cache, which also
+//    keeps recycled inode numbers from matching old entries.
+//
+
+class dentry_cache {
    private:
-      inode_state (const inode_state&) = delete; // copy ctor
-      inode_state& operator= (const inode_state&) = delete; // op=
-      inode_ptr root {nullptr};
-      inode_ptr cwd {nullptr};
-      string prompt {"% "};
+      struct dentry_hash {
+         size_t operator() (const pair<int,string>& key) const;
+      };
+      unordered_map<pair<int,string>,inode_id,dentry_hash> dentries;
+      unordered_map<string,inode_id> paths;
    public:
-      inode_state();
-      inode_ptr resolve_pathname(const string& pathname);
-      void set_prompt(const wordvec& words);
-      string get_prompt() const;
-      void cat(const string& pathname, ostream& out);
-      void cd();
-      void cd(const string& pathname);
-      void ls(ostream& out);
-      void ls(const string& pathname, ostream& out);
-      void lsr(ostream& out);
-      void lsr(const string& pathname, ostream& out);
-      void make(const string& pathname);
-      void make(const string& pathname, wordvec& data);
-      void mkdir(const string& pathname);
-      void pwd(ostream& out);
-      void rm(const string& pathname);
-      void rmr(const string& pathname);
-      void terminate();
+      inode_id lookup (inode_id parent, const string& name) const;
+      void insert (inode_id parent, const string& name, inode_id dir);
+      inode_id lookup_path (const string& prefix) const;
+      void insert_path (const string& prefix, inode_id dir);
+      void clear();
 };
 
 //
-// class inode -
+// name_index -
+//    Every name in the tree, in order, with the inode it names and
+//    the directory it is in, so that find can go straight to the
+//    names it wants instead of walking the tree.  It is kept up to
+//    date by the commands that add and remove names.  The names
+//    below a directory rmr removes are taken out once the reclaimer
+//    has found them, and restoring a snapshot changes only the
+//    names of what differs.  Loading a whole tree only marks it
+//    invalid, and it is built again from the tree the next time it
+//    is used.
+// parent -
+//    The directory the index has the name in, or NO_INODE.
+// find -
+//    Appends the (inode, parent) of every name matching a shell
+//    pattern, in name order.  Only names starting with the part of
+//    the pattern before its first wildcard are looked at, so a name
+//    or a prefix followed by * costs time in the number of matches.
 //
-// inode ctor -
-//    Create a new inode of the given type.
-// get_inode_nr -
-//    Retrieves the serial number of the inode.  Inode numbers are
-//    allocated in sequence by small integer.
-// size -
-//    Returns the size of an inode.  For a directory, this is the
-//    number of dirents.  For a text file, the number of characters
-//    when printed (the sum of the lengths of each word, plus the
-//    number of words.
-//    
 
-class inode {
-   friend class inode_state;
+class name_index {
    private:
-      static int next_inode_nr;
-      int inode_nr;
-      inode_t type;
-      file_base_ptr contents;
-      string name;
+      map<pair<string,inode_id>,inode_id> names;
+      bool valid {true};
    public:
-      inode (inode_t init_type);
-      size_t size() const;
-      void set_name(const string& iname);
-      string get_name() const;
-      int get_inode_nr() const;
-      int get_type() const;
-      file_base_ptr get_contents() const;
+      using match = pair<inode_id,inode_id>;
+      bool is_valid() const { return valid; }
+      void invalidate();
+      void clear();
+      void insert (const string& name, inode_id nr, inode_id parent);
+      void erase (const string& name, inode_id nr);
+      inode_id parent (const string& name, inode_id nr) const;
+      void find (const string& pattern, vector<match>& matches) const;
 };
 
 //
-// class file_base -
+// word_index -
+//    An inverted index of the contents of files:  for each word, the
+//    files it appears in and its positions in each, and for each
+//    file the directory it is in.  Like name_index, it is kept up
+//    to date by the commands that write and remove files, including
+//    rmr and restore, and is built again only after a whole tree is
+//    loaded.
+// add, remove -
+//    Index or unindex every word of a file.
+// parent -
+//    The directory the index has the file in, or NO_INODE.
+// find -
+//    Appends the (inode, parent) of every file containing all of
+//    the words, in inode order.  Only the files of the rarest word
+//    are looked at.
 //
-// Just a base class at which an inode can point.  No data or
-// functions.  Makes the synthesized members useable only from
-// the derived classes.
+
+class plain_file;
+
+class word_index {
+   private:
+      using postings = map<inode_id,vector<uint32_t>>;
+      unordered_map<string,postings> words;
+      unordered_map<inode_id,inode_id> parents;
+      bool valid {true};
+   public:
+      using match = pair<inode_id,inode_id>;
+      bool is_valid() const { return valid; }
+      void invalidate();
+      void clear();
+      void add (inode_id nr, inode_id parent, const plain_file& file);
+      void remove (inode_id nr, const plain_file& file);
+      inode_id parent (inode_id nr) const;
+      void find (const wordvec& query, vector<match>& matches) const;
+};
+
+//
+// class blob_pool -
+//
+// Holds each distinct file contents once, however many files have
+// them.  A blob is found by the hash of its bytes and shared by
+// every plain_file with those bytes.  A blob never changes:
+// writing a file gives it another blob, and a blob leaves the pool
+// with its last file.  Files are written and dropped by more than
+// one thread, so the pool is locked.
+// blob -
+//    The words of a file in one buffer, separated by single spaces
+//    exactly as cat prints them, with the offset of each word.
+// intern -
+//    The blob holding the bytes, which is added to the pool if it
+//    is not there already.
+// usage -
+//    How many blobs there are and how many files share them, and
+//    the bytes they hold against the bytes the files would hold
+//    each on their own.
 //
 
-class file_base {
-   protected:
-      file_base () = default;
-      file_base (const file_base&) = default;
-      file_base (file_base&&) = default;
-      file_base& operator= (const file_base&) = default;
-      file_base& operator= (file_base&&) = default;
-      virtual ~file_base () = default;
-      virtual size_t size() const = 0;
+class blob_pool {
    public:
-      friend plain_file_ptr plain_file_ptr_of (file_base_ptr);
-      friend directory_ptr directory_ptr_of (file_base_ptr);
+      struct blob {
+         string bytes;
+         vector<size_t> offsets;
+         size_t hash;
+      };
+      struct totals {
+         size_t blobs;
+         size_t files;
+         size_t stored;
+         size_t shared;
+      };
+      static shared_ptr<const blob> intern (string&& bytes,
+                                            vector<size_t>&& offsets);
+      static totals usage();
+   private:
+      struct entry {
+         const blob* address;
+         weak_ptr<const blob> owner;
+      };
+      static mutex lock;
+      static unordered_multimap<size_t,entry> blobs;
+      static void release (const blob* gone);
 };
 
 //
 // class plain_file -
 //
-// Used to hold data.
+// Used to hold data, as a blob shared with every other file with
+// the same contents.  An empty file has no blob.  A file imported
+// from the host has none either until it is first read.
 // synthesized default ctor -
-//    Default vector<string> is a an empty vector.
+//    An empty file.
+// size -
+//    The length of the contents, as cat prints them, or of the host
+//    file if it has not been read.
+// import, host_path -
+//    Makes the file stand for a host file of the given size, or
+//    returns that file's path while it is still to be read.
 // readfile -
-//    Returns a copy of the contents of the wordvec in the file.
-//    Throws an yshell_exn for a directory.
+//    Returns the contents.
+// word_count, word -
+//    The number of words, and the i'th word.
 // writefile -
-//    Replaces the contents of a file with new contents.
-//    Throws an yshell_exn for a directory.
+//    Replaces the contents of a file with the words of a command
+//    line.
+// writebytes -
+//    Replaces the contents with words already joined by spaces.
+// readwords -
+//    Replaces the contents with the words of a text, which may be
+//    separated by any white space.
+// shares -
+//    Whether the two files hold one blob, or stand for the same
+//    host file, and so have the same words.
 //
 
-class plain_file: public file_base {
+class plain_file {
    private:
-      wordvec data;
+      shared_ptr<const blob_pool::blob> contents;
+      string host;
+      size_t host_bytes {0};
    public:
-      size_t size() const override;
-      const wordvec& readfile() const;
-      void writefile (const wordvec& newdata);
+      size_t size() const {
+         if (not host.empty()) return host_bytes;
+         return contents == nullptr ? 0 : contents->bytes.size();
+      }
+      void import (const string& path, size_t bytes);
+      const string& host_path() const { return host; }
+      const string& readfile() const;
+      size_t word_count() const {
+         return contents == nullptr ? 0 : contents->offsets.size();
+      }
+      string word (size_t index) const;
+      void writefile (span_iter first, span_iter last);
+      void writebytes (const char* data, size_t length);
+      void readwords (const char* data, size_t length);
+      bool shares (const plain_file& that) const {
+         return contents == that.contents && host == that.host;
+      }
 };
 
 //
 // class directory -
 //
-// Used to map filenames onto inode pointers.
+// Used to map filenames onto inode numbers, through a dirmap so
+// that lookups do not walk a tree of string comparisons.  Functions
+// that create, remove or inspect other inodes are given the table.
+// A directory loaded from an image keeps its dirents in the image
+// until it is first used, and knows only how many there are.  It
+// is filled in under a lock, since threads reading a shared tree
+// may reach it together.  Copies of a directory share its dirents
+// until one of them changes them, so a snapshot that changes only
+// a directory's totals does not copy its dirents.  A directory
+// imported from the host has only dot and dotdot until inode_state
+// reads its entries.
 // default ctor -
 //    Creates a new map with keys "." and "..".
+// defer -
+//    Makes the dirents those of a range of the image's dirents.
 // remove -
 //    Removes the file or subdirectory from the current inode.
 //    Throws an yshell_exn if this is not a directory, the file
@@ -164,26 +278,484 @@ class plain_file: public file_base {
 // mkfile -
 //    Create a new empty text file with the given name.  Error if
 //    a dirent with that name exists.
+// remove_r -
+//    Removes the dirent of the subdirectory and returns its number,
+//    but releases nothing:  the subdirectory and everything below it
+//    are left for the reclaimer.  Throws an yshell_exn if there is
+//    no such dirent.
+// unlink_parent -
+//    Removes dotdot from a directory taken out of the tree, so that
+//    a walk up from anything below it stops there.
+// parent, set_parent -
+//    The number dotdot maps to, kept beside the dirents so that a
+//    walk up the tree neither hashes names nor fills in directories
+//    still in the image.  NO_INODE once the parent is unlinked.
+// tree_bytes, tree_inodes, tree_unread, add_below -
+//    The total size of the files below the directory, how many
+//    files and directories are below it, at any depth, and how many
+//    of them or the directory itself are imported and still to be
+//    read.  Kept up to date by inode_state as it adds, removes and
+//    reads inodes.
+// import, host_path -
+//    Makes the directory stand for a host directory, or returns
+//    that directory's path while its entries are still to be read.
+// children -
+//    Appends the number of each dirent other than dot and dotdot.
+//    A directory still in the image is read from the image without
+//    being filled in.
+// ls -
+//    Appends a line per dirent to the buffer, in name order.
+// entries -
+//    The dirents in name order.
+// shares_dirents -
+//    Whether the two directories are filled in and share their
+//    dirents, and so list the same inodes.
+
+using dirent = dirmap<inode_id>::entry;
+
+class directory {
+   private:
+      struct image_range {
+         shared_ptr<const fs_image> image;
+         uint64_t first;
+         uint64_t count;
+      };
+      mutable shared_ptr<dirmap<inode_id>> dirents {
+         make_shared<dirmap<inode_id>>()
+      };
+      mutable image_range pending;
+      mutable atomic<bool> filled {true};
+      static mutex fill_lock;
+      size_t bytes_below {0};
+      size_t inodes_below {0};
+      size_t unread_below {0};
+      inode_id parent_nr {NO_INODE};
+      string host;
+      const dirmap<inode_id>& loaded() const;
+      dirmap<inode_id>& writable();
+   public:
+      directory() = default;
+      directory (const directory& that);
+      directory& operator= (const directory&) = delete;
+      size_t tree_bytes() const { return bytes_below; }
+      size_t tree_inodes() const { return inodes_below; }
+      size_t tree_unread() const { return unread_below; }
+      void add_below (ptrdiff_t bytes, ptrdiff_t inodes,
+                      ptrdiff_t unread);
+      void import (const string& path) { host = path; }
+      const string& host_path() const { return host; }
+      void defer (shared_ptr<const fs_image> image, uint64_t first,
+                  uint64_t count);
+      void set_root(inode_table& table, inode_id root);
+      void set_parent_child(inode_id parent, inode_id child);
+      void remove   (inode_table& table, const string& filename,
+                     const string& pathname);
+      inode_id remove_r (const string& filename,
+                         const string& pathname);
+      void children (vector<inode_id>& numbers) const;
+      void unlink_parent();
+      inode_id parent() const { return parent_nr; }
+      void set_parent(inode_id nr) { parent_nr = nr; }
+      size_t size() const;
+      inode_id mkdir (inode_table& table, const string& dirname);
+      inode_id mkfile (inode_table& table, const string& filename);
+      inode_id lookup(const string& name) const;
+      const string& cat(const inode_table& table, const string& name,
+                        const string& pathname) const;
+      void ls(const inode_table& table, string& buffer) const;
+      void make(inode_table& table, const string& name,
+                const string& pathname);
+      void make(inode_table& table, const string& name, 
+                const string& pathname, span_iter first,
+                span_iter last);
+      const vector<const dirent*>& entries() const;
+      bool shares_dirents (const directory& that) const;
+};
+
+//
+// class inode -
+//
+// Inodes live in an inode_table rather than being allocated one at
+// a time, and are reached by their inode number.  The plain_file or
+// directory is held inline in a union tagged by the inode type, so
+// reaching it is a switch on the tag rather than a dynamic cast.
+// get_inode_nr -
+//    Retrieves the serial number of the inode.  Inode numbers are
+//    small integers, and the numbers of removed inodes are reused.
+// size -
+//    Returns the size of an inode.  For a directory, this is the
+//    number of dirents.  For a text file, the number of characters
+//    when printed (the sum of the lengths of each word, plus the
+//    number of words.
+// file, dir -
+//    The contents of the inode.  Throws an yshell_exn if the inode
+//    is of the other type.
+//    
+
+class inode {
+   friend class inode_state;
+   friend class inode_table;
+   private:
+      inode_id inode_nr {NO_INODE};
+      inode_t type {PLAIN_INODE};
+      union {
+         plain_file file_contents;
+         directory dir_contents;
+      };
+      string name;
+      void construct (inode_id nr, inode_t init_type);
+      void construct (const inode& that);
+      void destroy();
+   public:
+      inode() {}
+      inode (const inode&) = delete;
+      inode& operator= (const inode&) = delete;
+      ~inode();
+      size_t size() const;
+      void set_name(const string& iname);
+      string get_name() const;
+      int get_inode_nr() const;
+      int get_type() const;
+      plain_file& file();
+      const plain_file& file() const;
+      directory& dir();
+      const directory& dir() const;
+};
+
+//
+// class inode_table -
+//
+// Maps inode numbers onto inodes held inline in chunks of
+// CHUNK_SIZE slots, so that an inode costs no allocation and no
+// reference count of its own.  The chunks are the leaves of a
+// radix tree of branches of FANOUT pointers each, which grows a
+// level at the top whenever the numbers outgrow it.  Copying a
+// table copies only the pointer to the top of the tree, so a copy
+// is a snapshot that shares every chunk with the original.
+// Changes then copy on write:  the branches on the way down to the
+// chunk holding the inode being changed, and the chunk, are copied
+// if they are shared, and nothing else is.  So the first change
+// after a copy costs time in the height of the tree rather than
+// its size.  Chunks are kept small so that copying one costs
+// little more than copying the inode.  Inodes refer to each other
+// by number, so the directories above a changed inode need not be
+// copied.  The free numbers are a stack of blocks shared the same
+// way, of which a change copies only the top block.
+// allocate -
+//    Constructs a new inode of the given type in a free slot and
+//    returns its number.  Numbers freed by release are reused
+//    before new slots are handed out.
+// release -
+//    Destroys the contents of the inode and frees its number.
+// at -
+//    The inode with the given number, for reading.
+// edit -
+//    The inode with the given number, for changing.  The reference
+//    is not affected by editing or allocating other inodes, as long
+//    as the table is not copied in between.
+// allocate_at -
+//    Constructs a new inode with the given number, which must not
+//    be in use, when the table is being built from an image.
+// in_use -
+//    Whether the number is that of an inode.
+// next_number, free_numbers, set_numbers -
+//    The state of inode number allocation, saved with an image.
+//    The free numbers are listed in the order they were freed.
+// compare -
+//    Calls the function with the slot of this table and of that one
+//    for each number in a chunk the two do not share, and so
+//    whose inode may differ, skipping the branches they share.
+//    Each slot is given as its inode, or nullptr if not in use.
+//
+
+class inode_table {
+   private:
+      static constexpr size_t CHUNK_SIZE = 64;
+      static constexpr int FANOUT_BITS = 5;
+      static constexpr size_t FANOUT = 1 << FANOUT_BITS;
+      struct node {};
+      struct chunk: node {
+         inode slots[CHUNK_SIZE];
+         chunk() = default;
+         chunk (const chunk& that);
+      };
+      struct branch: node {
+         shared_ptr<node> below[FANOUT];
+      };
+      struct free_block {
+         inode_id nrs[CHUNK_SIZE];
+         size_t count {0};
+         shared_ptr<free_block> rest;
+         ~free_block();
+      };
+      shared_ptr<node> top;
+      int height {0};
+      shared_ptr<free_block> free_nrs;
+      inode_id next_nr {1};
+      const chunk* find_chunk (size_t index) const;
+      static const node* child (const node* part, int part_height,
+                                int level, size_t index);
+      using slot_visitor = function<void(const inode*, const inode*)>;
+      static void compare (const node* mine, int my_height,
+                           const node* theirs, int their_height,
+                           int level, const slot_visitor& visit);
+      inode& slot (inode_id nr);
+      void push_free (inode_id nr);
+      inode_id pop_free();
+   public:
+      inode_id allocate (inode_t type);
+      void release (inode_id nr);
+      const inode& at (inode_id nr) const;
+      inode& edit (inode_id nr);
+      bool in_use (inode_id nr) const;
+      void allocate_at (inode_id nr, inode_t type);
+      inode_id next_number() const { return next_nr; }
+      vector<inode_id> free_numbers() const;
+      void set_numbers (inode_id next, const vector<inode_id>& free);
+      void compare (const inode_table& that,
+                    const slot_visitor& visit) const;
+};
+
+//
+// class reclaimer -
+//
+// Frees removed subtrees on a thread of its own, so that rmr need
+// not visit every inode below the directory it removes.  A job is
+// a copy of the inode table, which shares every chunk with the
+// shell's, and the number of the subtree's directory.  The thread
+// walks the copy without recursion to find every number in the
+// subtree, and the shell releases those numbers in its own table
+// before it next allocates an inode, waiting for the walk if it
+// has not finished.  So the numbers are reused at the same point
+// however long the walk takes, and inode numbers do not depend on
+// timing.  The inodes then live on only in the copy, and are
+// destroyed on the thread when it drops the copy.
+// Chunks shared between tables are never changed, only copied, and
+// filling in a directory is done under a lock, so the thread reads
+// the copy safely while the shell goes on.
+// The thread is started by the first job, so a shell that never
+// removes a subtree never starts it, and started again by a job
+// given after stop.
+// detach -
+//    Queues the subtree below dir for walking.
+// collect -
+//    Waits for every walk queued, releases in the table the numbers
+//    found, and gives the copies back to the thread to drop.  Each
+//    number is given to the function just before it is released,
+//    while its inode is still in the table.
+// discard -
+//    Gives a table no longer needed to the thread to drop.
+// stop -
+//    Stops the thread, so that it frees nothing while the process
+//    exits.
+//
 
-class directory: public file_base {
+class reclaimer {
    private:
-      map<string,inode_ptr> dirents;
+      struct job {
+         inode_table table;
+         inode_id dir;
+         vector<inode_id> numbers;
+      };
+      mutex lock;
+      condition_variable wake;
+      condition_variable walked_all;
+      deque<job> waiting;
+      deque<job> walked;
+      vector<inode_table> garbage;
+      size_t unwalked {0};
+      bool stopping {false};
+      thread worker;
+      void start();
+      void run();
    public:
-      void set_root(inode_ptr root);
-      void set_parent_child(inode_ptr parent, inode_ptr child);
-      void remove   (const string& filename, const string& pathname);
-      void remove_r (const string& filename, const string& pathname);
-      void rec_empty();
-      size_t size() const override;
-      inode_ptr mkdir (const string& dirname);
-      inode_ptr mkfile (const string& filename);
-      inode_ptr lookup(const string& name);
-      const wordvec& cat(const string& name, const string& pathname);
+      reclaimer() = default;
+      reclaimer (const reclaimer&) = delete;
+      reclaimer& operator= (const reclaimer&) = delete;
+      ~reclaimer();
+      void detach (const inode_table& table, inode_id dir);
+      void collect (inode_table& table,
+                    const function<void(inode_id)>& releasing);
+      void discard (inode_table&& table);
+      void stop();
+};
+
+//
+// tree_version -
+//    A copy of the tree published for sessions to read, which is
+//    never changed.  The table shares every chunk with the one it
+//    was copied from, and number tells versions apart.
+//
+
+struct tree_version {
+   inode_table table;
+   inode_id root;
+   uint64_t number;
+};
+
+//
+// inode_state -
+//    A small convenient class to maintain the state of the simulated
+//    process:  the root (/), the current directory (.), the prompt,
+//    and the stream that commands write to.
+// save, load -
+//    Write the whole tree to a binary image file, or replace the
+//    tree with the one in an image.  See fsimage.h for the format.
+//    What is imported and not yet read is saved as the host path
+//    it stands for, and read after loading only when it is used.
+// snapshot, restore -
+//    Remember the tree and current directory under a name, or go
+//    back to them.  Both copy only a table, which shares its inodes.
+// list_snapshots -
+//    Prints the names of the snapshots.
+// stats -
+//    Prints how much the sharing of file contents saves.
+// find -
+//    Prints the path of everything whose name matches a pattern.
+// grep -
+//    Prints the path of every file containing all of the words.
+// du -
+//    Prints the total size of the files below a directory and how
+//    many inodes are below it, or the size of a file.  The totals
+//    are kept in each directory, so this does not walk the tree,
+//    and count only the imported directories read so far.
+// import -
+//    Makes a directory standing for a directory on the host.  Its
+//    entries are read the first time a path is looked up in it, as
+//    a directory and file for each host directory and regular
+//    file, and each file is read and split into words the first
+//    time it is cat.  lsr, find, grep and save need all of a tree,
+//    so first read whatever of it is still on the host.
+// has_unread -
+//    Whether anything imported is still to be read, in which case
+//    even cat, cd, du, ls and lsr may change the tree.
+// recover -
+//    Loads base.img if there is one, opens the journal base.log,
+//    and returns the commands logged after the image was written,
+//    for the caller to run again.
+// start_journal -
+//    From now on, logs every make, mkdir, rm, rmr and import in the
+//    journal.
+//    load and restore replace the whole tree, so instead of being
+//    logged they are followed by a checkpoint, as is a commit that
+//    finds the journal has grown past journal::CHECKPOINT_SIZE.  A
+//    checkpoint saves the tree to base.img and empties the journal.
+//    Snapshots are not kept.
+// commit -
+//    Waits for the journal records of every change so far to reach
+//    the disk.  Called after each command, or each block of them in
+//    batch mode, so one sync covers all of them.
+// publish -
+//    A new tree_version holding the tree as it is now.
+// follow -
+//    Makes the tree that of the version, keeping the working
+//    directory, prompt and output.  Nothing is copied if the version
+//    is the one already followed.
+// pwd -
+//    Prints the path of the working directory, which is kept with
+//    it and worked out again only when it changes, by cd, set_cwd,
+//    follow, load or restore.  No command renames a directory, so
+//    the path of one still in the tree never changes.
+// set_cwd -
+//    Makes the directory the working directory, given the path it
+//    had.  Here and in follow, and after rm and rmr, a directory no
+//    longer in the tree, or no longer at that path because its
+//    number was reused, means the root instead.
+// terminate -
+//    Called when the shell is about to exit.  The tree is not torn
+//    down, since the process gives back all of its memory at once,
+//    and the reclaimer stops freeing subtrees for the same reason.
+//
+
+class inode_state {
+   friend ostream& operator<< (ostream& out, const inode_state&);
+   private:
+      inode_state (const inode_state&) = delete; // copy ctor
+      inode_state& operator= (const inode_state&) = delete; // op=
+      inode_table table;
+      inode_id root {NO_INODE};
+      inode_id cwd {NO_INODE};
+      string cwd_path;
+      string prompt {"% "};
+      ostream* output {&cout};
+      uint64_t version {0};
+      dentry_cache dcache;
+      name_index names;
+      word_index contents;
+      void build_names();
+      void release_removed();
+      void reindex(const inode_table& before, inode_id before_root);
+      void build_contents();
+      void read_dir(inode_id dir);
+      void read_file(inode_id file, inode_id parent);
+      void read_below(inode_id dir, bool files);
+      string path_of(inode_id dir) const;
+      bool in_tree(inode_id dir) const;
+      bool above_cwd(inode_id dir) const;
+      void update_totals(inode_id dir, ptrdiff_t bytes,
+                         ptrdiff_t inodes, ptrdiff_t unread = 0);
+      struct snapshot_t {
+         inode_table table;
+         inode_id root;
+         inode_id cwd;
+         string cwd_path;
+      };
+      map<string,snapshot_t> snapshots;
+      reclaimer reclaim;
+      journal wal;
+      string journal_base;
+      bool journaling {false};
+      uint64_t load_image(const string& filename);
+      void log(const char* command, const string& pathname,
+               span_iter first, span_iter last);
+      void checkpoint();
+      const directory& dir_of (inode_id nr) const {
+         return table.at(nr).dir();
+      }
+      directory& edit_dir (inode_id nr) {return table.edit(nr).dir(); }
+   public:
+      inode_state();
+      inode_id resolve_pathname(const string& pathname);
+      void set_prompt(const spanvec& words);
+      string get_prompt() const;
+      ostream& out() { return *output; }
+      void set_output(ostream& stream) { output = &stream; }
+      inode_id get_cwd() const { return cwd; }
+      const string& get_cwd_path() const { return cwd_path; }
+      void set_cwd(inode_id dir, const string& path);
+      void cat(const string& pathname, ostream& out);
+      void cd();
+      void cd(const string& pathname);
       void ls(ostream& out);
-      void make(const string& name, const string& pathname);
-      void make(const string& name, 
-                const string& pathname, wordvec& data);
-      vector<inode_ptr> subdirs();
+      void ls(const string& pathname, ostream& out);
+      void lsr(ostream& out);
+      void lsr(const string& pathname, ostream& out);
+      void make(const string& pathname);
+      void make(const string& pathname, span_iter first,
+                span_iter last);
+      void mkdir(const string& pathname);
+      void import(const string& pathname, const string& host);
+      bool has_unread() const {
+         return dir_of(root).tree_unread() > 0;
+      }
+      void pwd(ostream& out);
+      void rm(const string& pathname);
+      void rmr(const string& pathname);
+      void save(const string& filename);
+      void load(const string& filename);
+      void snapshot(const string& name);
+      void restore(const string& name);
+      void list_snapshots(ostream& out) const;
+      void find(const string& pattern, ostream& out);
+      void grep(const wordvec& query, ostream& out);
+      void du(const string& pathname, ostream& out);
+      void stats(ostream& out) const;
+      vector<string> recover(const string& base);
+      void start_journal();
+      void commit();
+      shared_ptr<const tree_version> publish();
+      void follow(const tree_version& that);
+      void terminate();
 };
 
 #endif
@@ -0,0 +1,113 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 1
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "journal.h"
+#include "util.h"
+
+constexpr uint64_t journal::CHECKPOINT_SIZE;
+
+journal::~journal() {
+   if (fd >= 0) close (fd);
+}
+
+vector<string> journal::open (const string& name, uint64_t after) {
+   filename = name;
+   fd = ::open (filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0666);
+   if (fd < 0)
+      throw yshell_exn ("journal: " + filename + ": "
+                        + strerror (errno));
+   string log;
+   char block[1 << 16];
+   for (;;) {
+      ssize_t got = read (fd, block, sizeof block);
+      if (got < 0 and errno == EINTR) continue;
+      if (got < 0)
+         throw yshell_exn ("journal: " + filename + ": "
+                           + strerror (errno));
+      if (got == 0) break;
+      log.append (block, got);
+   }
+   vector<string> commands;
+   sequence = after;
+   size_t start = 0;
+   uint64_t previous = 0;
+   for (;;) {
+      size_t newline = log.find ('\n', start);
+      if (newline == string::npos) break;
+      char* end = nullptr;
+      uint64_t number = strtoull (log.c_str() + start, &end, 10);
+      if (end == log.c_str() + start || *end != ' '
+          || (previous != 0 && number != previous + 1)) break;
+      if (number > after) {
+         if (number != sequence + 1)
+            throw yshell_exn ("journal: " + filename
+                  + ": records after " + to_string (sequence)
+                  + " are missing");
+         const char* command = end + 1;
+         commands.emplace_back (command, log.c_str() + newline);
+         sequence = number;
+      }
+      previous = number;
+      start = newline + 1;
+   }
+   if (start < log.size()) {
+      DEBUGF ('j', filename << ": dropping " << log.size() - start
+              << " bytes after the last record");
+      if (ftruncate (fd, start) < 0)
+         throw yshell_exn ("journal: " + filename + ": "
+                           + strerror (errno));
+   }
+   bytes = start;
+   DEBUGF ('j', filename << ": " << commands.size()
+           << " records after " << after);
+   return commands;
+}
+
+void journal::append (const string& command) {
+   pending += to_string (++sequence);
+   pending += ' ';
+   pending += command;
+   pending += '\n';
+}
+
+void journal::commit() {
+   if (pending.empty()) return;
+   const char* next = pending.data();
+   const char* end = next + pending.size();
+   while (next < end) {
+      ssize_t wrote = write (fd, next, end - next);
+      if (wrote < 0 and errno == EINTR) continue;
+      if (wrote < 0)
+         throw yshell_exn ("journal: " + filename + ": "
+                           + strerror (errno));
+      next += wrote;
+   }
+   if (fdatasync (fd) < 0)
+      throw yshell_exn ("journal: " + filename + ": "
+                        + strerror (errno));
+   DEBUGF ('j', "committed " << pending.size() << " bytes up to "
+           << sequence);
+   bytes += pending.size();
+   pending.clear();
+}
+
+void journal::reset() {
+   pending.clear();
+   if (ftruncate (fd, 0) < 0 or fdatasync (fd) < 0)
+      throw yshell_exn ("journal: " + filename + ": "
+                        + strerror (errno));
+   bytes = 0;
+}
+
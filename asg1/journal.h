@@ -0,0 +1,68 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 1
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+//
+// class journal -
+//
+// An append-only log of the commands that changed the tree.  Each
+// record is a line holding its sequence number, a space and the
+// command, whose pathname has been made absolute so that it does
+// not depend on the working directory.  Records are collected in
+// memory and written and synced together by commit, so one sync
+// covers every command since the last.  A record counts only once
+// its newline is in the file, so one torn by a crash is dropped.
+// open -
+//    Reads the log and returns the commands of the records after
+//    sequence number after, which must follow each other and it
+//    without a gap.  The file is cut off after the last whole record
+//    and kept open for appending.  Throws an yshell_exn if it cannot
+//    be read or records are missing.
+// append -
+//    Adds a record for the command, numbered one past the last.
+// commit -
+//    Writes the records added since the last commit and waits for
+//    them to reach the disk.  Throws an yshell_exn on failure.
+// reset -
+//    Empties the log, once a checkpoint holds all of its records.
+//    Numbering carries on from the last record.
+// last -
+//    The sequence number of the last record, or the number given
+//    to open if there is none.
+// size -
+//    The bytes in the log, committed or not.
+//
+
+class journal {
+   private:
+      int fd {-1};
+      string filename;
+      string pending;
+      uint64_t sequence {0};
+      uint64_t bytes {0};
+   public:
+      static constexpr uint64_t CHECKPOINT_SIZE = 64 << 20;
+      journal() = default;
+      journal (const journal&) = delete;
+      journal& operator= (const journal&) = delete;
+      ~journal();
+      bool is_open() const { return fd >= 0; }
+      vector<string> open (const string& filename, uint64_t after);
+      void append (const string& command);
+      void commit();
+      void reset();
+      uint64_t last() const { return sequence; }
+      uint64_t size() const { return bytes + pending.size(); }
+};
+
+#endif
+
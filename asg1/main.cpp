@@ -3,10 +3,14 @@
 // ID:      1253060
 // Date:    2015 Jan 18
 
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <utility>
+#include <vector>
 #include <unistd.h>
 
 using namespace std;
@@ -14,22 +18,55 @@ using namespace std;
 #include "commands.h"
 #include "debug.h"
 #include "inode.h"
+#include "server.h"
 #include "util.h"
 
+//
+// options -
+//    What the command line asked for:  a filesystem image to load
+//    before reading commands, a journal to recover from and keep,
+//    a socket to serve sessions on, and whether to run in batch
+//    mode.
+//
+
+struct options {
+   string image;
+   string journal;
+   string socket;
+   bool batch {false};
+};
+
 //
 // scan_options
-//    Options analysis:  The only option is -Dflags. 
+//    Options analysis:  -@flags sets debug flags, -i image names a
+//    filesystem image to load before reading commands, -j base keeps
+//    the tree in base.img and the journal base.log, -s socket serves
+//    sessions on a Unix domain socket instead of reading stdin, and
+//    -b runs the commands in batch mode.
 //
 
-void scan_options (int argc, char** argv) {
+options scan_options (int argc, char** argv) {
+   options opts;
    opterr = 0;
    for (;;) {
-      int option = getopt (argc, argv, "@:");
+      int option = getopt (argc, argv, "@:bi:j:s:");
       if (option == EOF) break;
       switch (option) {
          case '@':
             debugflags::setflags (optarg);
             break;
+         case 'b':
+            opts.batch = true;
+            break;
+         case 'i':
+            opts.image = optarg;
+            break;
+         case 'j':
+            opts.journal = optarg;
+            break;
+         case 's':
+            opts.socket = optarg;
+            break;
          default:
             complain() << "-" << (char) option << ": invalid option"
                        << endl;
@@ -39,58 +76,208 @@ void scan_options (int argc, char** argv) {
    if (optind < argc) {
       complain() << "operands not permitted" << endl;
    }
+   return opts;
+}
+
+//
+// execute -
+//    Splits a command line into words, looks up the command and
+//    calls it.  Any yshell_exn it throws is complained about here.
+//    Blank lines and comments are ignored.  words is scratch space
+//    for the spans of the line, kept by the caller between lines.
+//
+
+void execute (commands& cmdmap, inode_state& state,
+              const string& line, spanvec& words) {
+   try {
+      // Split the line into words and lookup the appropriate
+      // function.  Complain or call it.
+      split_spans (line, " \t", words);
+      DEBUGF ('y', "words = " << words);
+      if (words.size() == 0) return;
+      if (words.at(0) == "#") return;
+      command_fn fn = cmdmap.at(words.at(0));
+      fn (state, words);
+   }catch (yshell_exn& exn) {
+      // If there is a problem discovered in any function, an
+      // exn is thrown and printed here.
+      complain() << exn.what() << endl;
+   }
+}
+
+//
+// commit -
+//    Commits the journal, complaining if it cannot be written.
+//
+
+void commit (inode_state& state) {
+   try {
+      state.commit();
+   }catch (yshell_exn& exn) {
+      complain() << exn.what() << endl;
+   }
+}
+
+//
+// recover -
+//    Rebuilds the tree from the journal by running again every
+//    command logged since the last checkpoint, then starts logging.
+//    In batch mode the time taken is reported on cerr.
+//
+
+void recover (commands& cmdmap, inode_state& state,
+              const string& base, bool batch) {
+   auto start = chrono::steady_clock::now();
+   vector<string> lines;
+   try {
+      lines = state.recover (base);
+   }catch (yshell_exn& exn) {
+      complain() << exn.what() << endl;
+      return;
+   }
+   spanvec words;
+   for (const string& line: lines)
+      execute (cmdmap, state, line, words);
+   state.start_journal();
+   chrono::duration<double> elapsed = chrono::steady_clock::now()
+                                    - start;
+   if (batch)
+      cerr << execname() << ": recovered " << lines.size()
+           << " commands in " << elapsed.count() << " seconds"
+           << endl;
+}
+
+//
+// run_interactive -
+//    Loops reading commands until end of file, printing the prompt
+//    and echoing each line if one is needed.
+//
+
+void run_interactive (commands& cmdmap, inode_state& state) {
+   bool need_echo = want_echo();
+   spanvec words;
+   for (;;) {
+      // Read a line, break at EOF, and echo print the prompt
+      // if one is needed.
+      cout << state.get_prompt();
+      string line;
+      getline (cin, line);
+      if (cin.eof()) {
+         if (need_echo) cout << "^D";
+         cout << endl;
+         DEBUGF ('y', "EOF");
+         break;
+      }
+      if (need_echo) cout << line << endl;
+      execute (cmdmap, state, line, words);
+      commit (state);
+   }
+}
+
+//
+// run_batch -
+//    Reads the script from stdin in large blocks and runs each line
+//    without a prompt or echo.  cout is given an output_buffer for
+//    the run.  The journal is committed once for each block, so a
+//    sync covers many commands.  At the end the number of commands
+//    run and the rate are reported on cerr.
+//
+
+void run_batch (commands& cmdmap, inode_state& state) {
+   constexpr size_t BLOCK_SIZE = 1 << 20;
+   output_buffer out (STDOUT_FILENO);
+   streambuf* saved = cout.rdbuf (&out);
+   vector<char> block (BLOCK_SIZE);
+   string line;
+   spanvec words;
+   size_t count = 0;
+   bool exiting = false;
+   auto start = chrono::steady_clock::now();
+   try {
+      for (;;) {
+         ssize_t got = read (STDIN_FILENO, block.data(), block.size());
+         if (got < 0 and errno == EINTR) continue;
+         if (got <= 0) break;
+         const char* next = block.data();
+         const char* end = next + got;
+         for (;;) {
+            const char* newline = static_cast<const char*>
+                  (memchr (next, '\n', end - next));
+            if (newline == nullptr) {
+               line.append (next, end);
+               break;
+            }
+            line.append (next, newline);
+            execute (cmdmap, state, line, words);
+            ++count;
+            line.clear();
+            next = newline + 1;
+         }
+         commit (state);
+      }
+      if (not line.empty()) {
+         execute (cmdmap, state, line, words);
+         ++count;
+      }
+   }catch (ysh_exit_exn&) {
+      ++count;
+      exiting = true;
+   }
+   out.drain();
+   cout.rdbuf (saved);
+   chrono::duration<double> elapsed = chrono::steady_clock::now()
+                                    - start;
+   cerr << execname() << ": " << count << " commands in "
+        << elapsed.count() << " seconds";
+   if (elapsed.count() > 0)
+      cerr << ", " << size_t (count / elapsed.count())
+           << " commands/sec";
+   cerr << endl;
+   if (exiting) throw ysh_exit_exn();
 }
 
-
+
 //
 // main -
-//    Main program which loops reading commands until end of file.
+//    Main program which runs commands until end of file or exit.
 //
 
 int main (int argc, char** argv) {
    execname (argv[0]);
    cout << boolalpha; // Print false or true instead of 0 or 1.
    cerr << boolalpha;
-   cout << argv[0] << " build " << __DATE__ << " " << __TIME__ << endl;
-   scan_options (argc, argv);
-   bool need_echo = want_echo();
+   options opts = scan_options (argc, argv);
+   if (not opts.batch)
+      cout << argv[0] << " build " << __DATE__ << " " << __TIME__
+           << endl;
    commands cmdmap;
    inode_state state;
-   try {
-      for (;;) {
-         try {
-   
-            // Read a line, break at EOF, and echo print the prompt
-            // if one is needed.
-            cout << state.get_prompt();
-            string line;
-            getline (cin, line);
-            if (cin.eof()) {
-               if (need_echo) cout << "^D";
-               cout << endl;
-               DEBUGF ('y', "EOF");
-               break;
-            }
-            if (need_echo) cout << line << endl;
-   
-            // Split the line into words and lookup the appropriate
-            // function.  Complain or call it.
-            wordvec words = split (line, " \t");
-            DEBUGF ('y', "words = " << words);
-            if (words.size() == 0) continue;
-            if (words.at(0) == "#") continue;
-            command_fn fn = cmdmap.at(words.at(0));
-            fn (state, words);
-         }catch (yshell_exn& exn) {
-            // If there is a problem discovered in any function, an
-            // exn is thrown and printed here.
-            complain() << exn.what() << endl;
-         }
+   if (not opts.journal.empty())
+      recover (cmdmap, state, opts.journal, opts.batch);
+   if (not opts.image.empty()) {
+      try {
+         state.load (opts.image);
+      }catch (yshell_exn& exn) {
+         complain() << exn.what() << endl;
       }
+   }
+   try {
+      if (not opts.socket.empty())
+         server (cmdmap, state).run (opts.socket);
+      else if (opts.batch)
+         run_batch (cmdmap, state);
+      else
+         run_interactive (cmdmap, state);
    } catch (ysh_exit_exn& ) {
       // This catch intentionally left blank.
+   } catch (yshell_exn& exn) {
+      complain() << exn.what() << endl;
    }
+   commit (state);
+   state.terminate();
 
-   return exit_status_message();
+   // Exit without destroying state:  the whole tree goes back to the
+   // system at once, far faster than inode by inode.
+   exit (exit_status_message());
 }
 
@@ -0,0 +1,161 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 8
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "server.h"
+
+// The commands a session runs on the version it follows.
+static bool reads_only (const word_span& cmd) {
+   static const char* const readers[] {
+      "cat", "cd", "du", "echo", "ls", "lsr", "prompt", "pwd",
+   };
+   for (const char* name: readers)
+      if (cmd == name) return true;
+   return false;
+}
+
+server::server (const commands& cmdmap_, inode_state& state_):
+        cmdmap (cmdmap_), state (state_), current (state.publish()) {
+}
+
+void server::run (const string& path) {
+   // A client that goes away must not take the server with it.
+   signal (SIGPIPE, SIG_IGN);
+   sockaddr_un address {};
+   address.sun_family = AF_UNIX;
+   if (path.size() >= sizeof address.sun_path)
+      throw yshell_exn ("server: " + path + ": name too long");
+   strcpy (address.sun_path, path.c_str());
+   int listener = socket (AF_UNIX, SOCK_STREAM, 0);
+   if (listener < 0)
+      throw yshell_exn ("server: " + path + ": " + strerror (errno));
+   unlink (path.c_str());
+   if (bind (listener, reinterpret_cast<sockaddr*> (&address),
+             sizeof address) < 0
+       or listen (listener, SOMAXCONN) < 0) {
+      int error = errno;
+      close (listener);
+      throw yshell_exn ("server: " + path + ": " + strerror (error));
+   }
+   DEBUGF ('v', "listening on " << path);
+   for (;;) {
+      int client = accept (listener, nullptr, nullptr);
+      if (client < 0 and errno == EINTR) continue;
+      if (client < 0) {
+         complain() << "server: " << path << ": " << strerror (errno)
+                    << endl;
+         break;
+      }
+      DEBUGF ('v', "session on " << client);
+      thread (&server::serve, this, client).detach();
+   }
+   close (listener);
+   unlink (path.c_str());
+}
+
+// Reads the session's commands in blocks, as batch mode does, but
+// prints the prompt before each and sends the output at the end of
+// each block.
+void server::serve (int fd) {
+   output_buffer buffer (fd, 1 << 16);
+   ostream out (&buffer);
+   inode_state session;
+   session.set_output (out);
+   session.follow (*atomic_load (&current));
+   vector<char> block (1 << 16);
+   string line;
+   spanvec words;
+   bool open = true;
+   out << session.get_prompt();
+   buffer.drain();
+   while (open) {
+      ssize_t got = read (fd, block.data(), block.size());
+      if (got < 0 and errno == EINTR) continue;
+      if (got <= 0) break;
+      const char* next = block.data();
+      const char* end = next + got;
+      while (open) {
+         const char* newline = static_cast<const char*>
+               (memchr (next, '\n', end - next));
+         if (newline == nullptr) {
+            line.append (next, end);
+            break;
+         }
+         line.append (next, newline);
+         open = execute (session, line, words);
+         if (open) out << session.get_prompt();
+         line.clear();
+         next = newline + 1;
+      }
+      buffer.drain();
+   }
+   DEBUGF ('v', "session on " << fd << " closed");
+   buffer.drain();
+   close (fd);
+}
+
+// Errors go to the session rather than through complain, which
+// would change the exit status of the whole server.  Any exception
+// is caught here, since one escaping a session's thread would end
+// every session.  Returns false when the session asks to exit.
+bool server::execute (inode_state& session, const string& line,
+                      spanvec& words) {
+   try {
+      split_spans (line, " \t", words);
+      if (words.size() == 0) return true;
+      if (words.at(0) == "#") return true;
+      if (words.at(0) == "exit") return false;
+      command_fn fn = cmdmap.at (words.at(0));
+      if (reads_only (words.at(0))) {
+         session.follow (*atomic_load (&current));
+         if (not session.has_unread() or words.at(0) == "prompt") {
+            fn (session, words);
+            return true;
+         }
+      }
+      write (session, fn, words);
+   }catch (exception& exn) {
+      session.out() << execname() << ": " << exn.what() << endl;
+   }
+   return true;
+}
+
+// The shared state runs the command as if it were the session, and
+// the session then follows the version the command made, even if
+// the command failed part way.
+void server::write (inode_state& session, command_fn fn,
+                    const spanvec& words) {
+   lock_guard<mutex> guard (writer);
+   state.set_cwd (session.get_cwd(), session.get_cwd_path());
+   state.set_output (session.out());
+   auto publish = [&] {
+      state.set_output (cout);
+      state.commit();
+      atomic_store (&current, state.publish());
+      session.follow (*current);
+      session.set_cwd (state.get_cwd(), state.get_cwd_path());
+   };
+   try {
+      fn (state, words);
+   }catch (exception&) {
+      publish();
+      throw;
+   }
+   publish();
+}
+
@@ -0,0 +1,60 @@
+// Author:  Andrew Edwards
+// Email:   ancedwar@ucsc.edu
+// ID:      1253060
+// Date:    2015 Feb 8
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <memory>
+#include <mutex>
+#include <string>
+using namespace std;
+
+#include "commands.h"
+#include "inode.h"
+#include "util.h"
+
+//
+// class server -
+//
+// Serves one tree to many sessions over a Unix domain socket, each
+// client connection being a session on a thread of its own.  A
+// session keeps its working directory, prompt and output in an
+// inode_state of its own, which follows the latest published
+// tree_version.  Commands that only read (cat, cd, du, echo, ls,
+// lsr, prompt, pwd) run there, without locks, so any number run at
+// once.  Every other command runs on the shared inode_state under
+// the writer lock, which then publishes a new version.  So do the
+// reading commands but prompt while an import is still partly on
+// the host, since reading it changes the tree, and is then done
+// once for every session.  A version shares every inode it has not
+// changed with the one before, and lives until the last session
+// reading it follows a newer one.
+// ctor -
+//    Serves the shared state, dispatching through the commands.
+// run -
+//    Listens on the socket at the path and serves each connection
+//    until accept fails.  Throws an yshell_exn if it cannot listen.
+//
+
+class server {
+   private:
+      const commands& cmdmap;
+      inode_state& state;
+      mutex writer;
+      shared_ptr<const tree_version> current;
+      void serve (int fd);
+      bool execute (inode_state& session, const string& line,
+                    spanvec& words);
+      void write (inode_state& session, command_fn fn,
+                  const spanvec& words);
+   public:
+      server (const commands& cmdmap, inode_state& state);
+      server (const server&) = delete;
+      server& operator= (const server&) = delete;
+      void run (const string& path);
+};
+
+#endif
+
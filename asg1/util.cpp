@@ -1,6 +1,8 @@
 // $Id: util.cpp,v 1.10 2014-06-11 13:34:25-07 - - $
 
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 
 using namespace std;
@@ -58,9 +60,67 @@ wordvec split (const string& line, const string& delimiters) {
    return words;
 }
 
+bool word_span::operator== (const char* word) const {
+   return strncmp (data, word, size) == 0 and word[size] == '\0';
+}
+
+ostream& operator<< (ostream& out, const word_span& word) {
+   return out.write (word.data, word.size);
+}
+
+void split_spans (const string& line, const char* delimiters,
+                  spanvec& words) {
+   words.clear();
+   size_t end = 0;
+   for (;;) {
+      size_t start = line.find_first_not_of (delimiters, end);
+      if (start == string::npos) break;
+      end = line.find_first_of (delimiters, start);
+      if (end == string::npos) end = line.size();
+      words.push_back (word_span {line.data() + start, end - start});
+   }
+   DEBUGF ('u', words);
+}
+
 ostream& complain() {
    exit_status::set (EXIT_FAILURE);
    cerr << execname() << ": ";
    return cerr;
 }
 
+output_buffer::output_buffer (int fd_, size_t size):
+               fd (fd_), buffer (size), terminal (isatty (fd_)) {
+   setp (buffer.data(), buffer.data() + buffer.size());
+}
+
+output_buffer::~output_buffer() {
+   drain();
+}
+
+output_buffer::int_type output_buffer::overflow (int_type ch) {
+   drain();
+   if (not traits_type::eq_int_type (ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type (ch);
+      pbump (1);
+   }
+   return traits_type::not_eof (ch);
+}
+
+void output_buffer::drain() {
+   const char* next = pbase();
+   while (next < pptr()) {
+      ssize_t written = write (fd, next, pptr() - next);
+      if (written < 0) {
+         if (errno == EINTR) continue;
+         break;
+      }
+      next += written;
+   }
+   setp (buffer.data(), buffer.data() + buffer.size());
+}
+
+void flush_terminal (ostream& out) {
+   output_buffer* buffer = dynamic_cast<output_buffer*> (out.rdbuf());
+   if (buffer != nullptr and buffer->is_terminal()) buffer->drain();
+}
+
@@ -78,6 +78,33 @@ class exit_status {
 
 wordvec split (const string& line, const string& delimiter);
 
+//
+// word_span -
+//    A word of a command line, held as a pointer to its first char
+//    and a length, so that splitting a line copies none of it.  A
+//    span is valid only while the line it points into is unchanged.
+//    str copies the word out when a string is really needed.
+// split_spans -
+//    As split, but fills words with spans into the line.  words is
+//    cleared first, so a caller can reuse it from line to line.
+//
+
+struct word_span {
+   const char* data;
+   size_t size;
+   char back() const { return data[size - 1]; }
+   string str() const { return string (data, size); }
+   bool operator== (const char* word) const;
+};
+
+using spanvec = vector<word_span>;
+using span_iter = spanvec::const_iterator;
+
+ostream& operator<< (ostream& out, const word_span& word);
+
+void split_spans (const string& line, const char* delimiters,
+                  spanvec& words);
+
 // complain -
 //    Used for starting error messages.  Sets the exit status to
 //    EXIT_FAILURE, writes the program name to cerr, and then
@@ -87,6 +114,37 @@ wordvec split (const string& line, const string& delimiter);
 
 ostream& complain();
 
+//
+// output_buffer -
+//    A streambuf that collects output in one large buffer and writes
+//    it to a file descriptor only when the buffer is full, when
+//    drain is called, or when it is destroyed.  Flushes, such as
+//    those done by endl, are ignored, so that a batch run does not
+//    make a system call for every line of output.
+// flush_terminal -
+//    Drains the stream's output_buffer if it writes to a terminal,
+//    so that output meant to be read now is not held back.
+//
+
+class output_buffer: public streambuf {
+   private:
+      int fd;
+      vector<char> buffer;
+      bool terminal;
+   protected:
+      int_type overflow (int_type ch) override;
+      int sync() override { return 0; }
+   public:
+      explicit output_buffer (int fd, size_t size = 1 << 20);
+      output_buffer (const output_buffer&) = delete;
+      output_buffer& operator= (const output_buffer&) = delete;
+      ~output_buffer();
+      void drain();
+      bool is_terminal() const { return terminal; }
+};
+
+void flush_terminal (ostream& out);
+
 
 //
 // operator<< (vector) -
@@ -37,7 +37,7 @@ bigint::bigint (const string& that) {
 
 // Initialization method
 // Takes a string representing a number and instantiates the
-// bigvalue_t vector with the corresponding digits.
+// bigvalue_t vector with the corresponding limbs.
 // 
 // The input can indicate negativity via '_' (if it comes from
 // the user input) or '-' (if it comes from the to_string method
@@ -51,146 +51,32 @@ void bigint::init (const string& that) {
         ++itor;
     }
     int newval = 0;
-    while (itor != that.end()) {
-        newval = newval * 10 + *itor++ - '0';
-    }
-    for (auto ritor  = that.crbegin(); 
-            ritor != that.crend() && *ritor != '_';
-            ritor++) {
-        big_value.push_back(*ritor - '0');
+    string digits (itor, that.cend());
+    for (char digit: digits) {
+        newval = newval * 10 + digit - '0';
     }
+    big_value = kernel::from_decimal(digits);
     long_value = negative ? - newval : + newval;
 }
 
-// Adds two digit vectors. 
-// Same logic as addition by hand.
-bigvalue_t do_bigadd (const bigvalue_t& left, 
-                      const bigvalue_t& right) {
-    bigvalue_t sum;
-    digit_t carry(0);
-    digit_t digit_sum(0);
-    size_t min_size = min(left.size(), right.size());
-    size_t i;
-    for (i = 0; i < min_size; i++) {
-        // Compute digit sum. If greater than 9, take note
-        // with the carry bit and deduct 10 from the sum.
-        digit_sum = left.at(i) + right.at(i) + carry;
-        if (digit_sum > 9) {
-            carry = 1;
-            digit_sum -= 10;
-        } else {
-            carry = 0;
-        }
-        sum.push_back(digit_sum);
-    }
-    while (i < left.size()) {
-        digit_sum = left.at(i) + carry;
-        if (digit_sum > 9) {
-            carry = 1;
-            digit_sum -= 10;
-        } else {
-            carry = 0;
-        }
-        sum.push_back(digit_sum);
-        i++;
-    }
-    while (i < right.size()) {
-        digit_sum = right.at(i) + carry;
-        if (digit_sum > 9) {
-            carry = 1;
-            digit_sum -= 10;
-        } else {
-            carry = 0;
-        }
-        sum.push_back(digit_sum);
-        i++;
-    }
-
-    // Last step: if the carry bit is set, we need to
-    // push back a 1 to be the new highest digit.
-    if (carry == 1)
-        sum.push_back(1);
-
-    return sum;
-}
-
-// Subtracts two digit vectors. 
-// Same logic as subtraction by hand. 
-// Precondition:  left >= right
-// Postcondition: result >= 0
-bigvalue_t do_bigsub (const bigvalue_t& left, 
-                      const bigvalue_t& right) {
-    bigvalue_t diff;
-    digit_t borrow(0);
-    digit_t digit_diff(0);
-    size_t i;
-    for (i = 0; i < right.size(); i++) {
-        // Check if we need to borrow from the next highest digit
-        if (left.at(i) - borrow < right.at(i)) {
-            digit_diff = 10 + left.at(i) - right.at(i) - borrow; 
-            borrow = 1;
-        } else {
-            digit_diff = left.at(i) - right.at(i) - borrow;
-            borrow = 0;
-        }
-        diff.push_back(digit_diff);
-    }
-    while (i < left.size()) {
-        if (left.at(i) < borrow) {
-            digit_diff = 10 + left.at(i) - borrow; 
-            borrow = 1;
-        } else {
-            digit_diff = left.at(i) - borrow;
-            borrow = 0;
-        }
-        diff.push_back(digit_diff);
-        i++;
-    }
-    // Remove leading zeroes
-    while (diff.size() > 1 && diff.back() == 0)
-        diff.pop_back();
-    return diff;
-}
-
-// Returns true if left < right, assumes both are positive
-// integers.
-bool do_bigless (const bigvalue_t& left,
-                 const bigvalue_t& right) {
-    // if the vectors' sizes differ the answer is trivial
-    if (left.size() < right.size())
-        return true;
-    else if (left.size() > right.size())
-        return false;
-
-    // iterate from highest order digits to find smaller input
-    auto lit = left.crbegin();
-    auto rit = right.crbegin();
-    for (; lit != left.crend(); lit++, rit++)
-        if (*lit < *rit)
-            return true;
-        else if (*lit > *rit)
-            return false;
-
-    // in this case they are equal
-    return false;
-}
-
 // Overloading the addition and subtraction operators.  
 // Determines proper sign and makes the appropriate call to 
-// do_bigadd or do_bigless.
+// kernel::add or kernel::sub.
 
 bigint operator+ (const bigint& left, const bigint& right) {
     bigint sum;
     if (left.negative == right.negative) {
-        sum.big_value = do_bigadd(left.big_value, right.big_value);
+        sum.big_value = kernel::add(left.big_value, right.big_value);
         sum.negative = left.negative;
         return sum;
     } else {
-        if (do_bigless(left.big_value, right.big_value)) {
-            sum.big_value = do_bigsub(right.big_value, left.big_value);
+        if (kernel::less(left.big_value, right.big_value)) {
+            sum.big_value = kernel::sub(right.big_value,
+                    left.big_value);
             sum.negative = right.negative;
         } else { 
-            sum.big_value = do_bigsub(left.big_value, right.big_value);
+            sum.big_value = kernel::sub(left.big_value,
+                    right.big_value);
             sum.negative = left.negative;
         }
         return sum;
@@ -200,12 +86,12 @@ bigint operator+ (const bigint& left, const bigint& right) {
 bigint operator- (const bigint& left, const bigint& right) {
     bigint diff;
     if (left.negative == right.negative) {
-        if (do_bigless(left.big_value, right.big_value)) {
-            diff.big_value = do_bigsub(right.big_value, 
+        if (kernel::less(left.big_value, right.big_value)) {
+            diff.big_value = kernel::sub(right.big_value, 
                     left.big_value);
             diff.negative = not right.negative;
         } else {
-            diff.big_value = do_bigsub(left.big_value,
+            diff.big_value = kernel::sub(left.big_value,
                     right.big_value);
             diff.negative = left.negative;
         }
@@ -213,7 +99,7 @@ bigint operator- (const bigint& left, const bigint& right) {
         return diff;
     } else {
         diff.negative = left.negative;
-        diff.big_value = do_bigadd(left.big_value, 
+        diff.big_value = kernel::add(left.big_value, 
                 right.big_value);
         return diff;
     }
@@ -233,257 +119,68 @@ bigint operator- (const bigint& right) {
     return pos_bigint;
 }
 
-// Multiplies two digit vectors. 
-// Same logic as long multiplication 
-bigvalue_t do_bigmul (const bigvalue_t& left, const bigvalue_t& right) {
-    bigvalue_t product(left.size() + right.size(), 0);
-    digit_t c, d;
-    for (size_t i = 0; i < left.size(); i++) {
-        c = 0;
-        for (size_t j = 0; j < right.size(); j++) {
-            d = product.at(i+j) + (left.at(i) * right.at(j)) + c;
-            product.at(i+j) = d % 10;
-            c = d / 10;
-        }
-        product.at(i + right.size()) = c;
-    }
-    while (product.size() > 1 && product.back() == 0)
-        product.pop_back();
-    return product;
-}
-
 bigint operator* (const bigint& left, const bigint& right) {
     bigint product;
     product.negative = (left.negative != right.negative);
-    product.big_value = do_bigmul(left.big_value, 
+    product.big_value = kernel::mul(left.big_value, 
             right.big_value);
     return product;
 }
 
-//
-// Long division algorithm.
-//
-// From P. Brinch Hansen,
-// Multiple-length division revisited: A tour of the minefield.
-
-// Partial product, quotient, and remainder assume that
-// x is a multiple length integer and k is a single digit
-// i.e. 0 <= k < 10
-
-bigvalue_t partial_prod(const bigvalue_t& x, size_t k) {
-    int temp, carry;
-    size_t size = x.size();
-    bigvalue_t product(x.size() + 1, 0);
-    carry = 0;
-    for (size_t i = 0; i < size; i++) {
-        temp = x.at(i) * k + carry;
-        product.at(i) = temp % 10;
-        carry = temp / 10;
-    }
-    product.at(size) = carry;
-    while (product.size() > 1 && product.back() == 0)
-        product.pop_back();
-    DEBUGF ('/', "partial_prod(" << x << ", "
-                 << (int) k << ") = " << product)
-    return product;
-}
-
-bigvalue_t partial_quot(const bigvalue_t& x, size_t k) {
-    int temp, carry;
-    size_t size = x.size();
-    bigvalue_t quotient(x.size(), 0);
-    carry = 0;
-    for (size_t i = size - 1; i < size; i--) {
-        temp = x.at(i) + 10 * carry;
-        quotient.at(i) = temp / k;
-        carry = temp % k;
-    }
-    while (quotient.size() > 1 && quotient.back() == 0)
-        quotient.pop_back();
-    DEBUGF ('/', "partial_quot(" << x << ", " 
-                 << k << ") = " << quotient)
-    return quotient;
-}
-
-bigvalue_t partial_rem(const bigvalue_t& x, size_t k) {
-    int carry;
-    size_t size = x.size();
-    carry = 0;
-    for (size_t i = size - 1; i < size; i--) {
-        carry = (x.at(i) + 10 * carry) % k;
-    }
-    // Since k is a digit, the remainder must also be a digit
-    DEBUGF ('/', "partial_rem(" << x << ", " 
-                 << k << ") = " << carry)
-    return bigvalue_t(1, carry);
-}
-
-//
-// The computation of a quotient digit q_k breaks down into the
-// simpler prefix operations. The assignment
-//          q_t = trialdigit(r, d, k, m)
-// defines a trial digit, q_t = q_e, which is an inital estimate
-// of q_k. The operands of the trial digit function are prefixes
-// of the remainder r and the divisor d
-//      r[k + m - 2 ... k + m]    d[m - 1 ... m - 2]
-// where
-//          2 <= m <= k + m
-//
-
-digit_t trialdigit(const bigvalue_t& r, const bigvalue_t& d,
-                   size_t k, size_t m) {
-    DEBUGF ('/', "trialdigit(" << r << ", " << d << ", " << 
-                 (int) k << ", " << (int) m << ")") 
-    int d2, r3;
-    size_t km;
-    km = k + m;
-    if (r.size() > km)
-        r3 = (r.at(km)*10 + r.at(km - 1))*10 + r.at(km - 2);
-    else if (r.size() > km - 1)
-        r3 = r.at(km - 1)*10 + r.at(km - 2);
-    else if (r.size() > km - 2)
-        r3 = r.at(km - 2);
-    else
-        r3 = 0;
-
-    if (d.size() > m - 1)
-        d2 = d.at(m - 1)*10 + d.at(m - 2);
-    else if (d.size() > m - 2)
-        d2 = d.at(m - 2);
-    else
-        d2 = 0;
-
-    DEBUGF ('/', "trialdigit = " << min(r3 / d2, 9))
-    return min(r3 / d2, 9);
-}
-
-
-// Returns r[k ... k + m] < dq 
-// (Note dq = dq[m ... 0])
-bool smaller(const bigvalue_t& r, const bigvalue_t& dq,
-                size_t k, size_t m) {
-    DEBUGF ('/', "smaller(" << r << ", " << dq << ", " <<
-                (int) k << ", " << (int) m << ")")
-    int i, j;
-
-    // Add leading zeroes if necessary, to make comparison easier
-    bigvalue_t r_copy(r);
-    while (r_copy.size() <= m + k)
-        r_copy.push_back(0);
-
-    bigvalue_t dq_copy(dq);
-    while (dq_copy.size() <= m)
-        dq_copy.push_back(0);
-
-    i = m;
-    j = 0;
-    while (i != j)
-        if (r_copy.at(i + k) != dq_copy.at(i))
-            j = i;
-        else
-            i = i - 1;
-
-    return r_copy.at(i + k) < dq_copy.at(i);
-}
-
-// Returns r - dq * 10^k, corresponding to the long divison step of
-// subtracting from the high order digits of the current remainder.
-bigvalue_t difference(const bigvalue_t& r, const bigvalue_t& dq,
-                      size_t k, size_t m) {
-    bigvalue_t dq_shifted;
-    // Do the multiplication locally, since it is trivial
-    for (size_t i = 0; i < k; i++)
-        dq_shifted.push_back(0);
-    for (auto it = dq.cbegin(); it != dq.cend(); it++)
-        dq_shifted.push_back(*it);
-
-    DEBUGF ('/', "difference(" << r << ", " << dq << ", " <<
-                (int) k << ", " << (int) m << ")" << " = " 
-                << do_bigsub (r, dq_shifted))
-
-    return do_bigsub (r, dq_shifted); 
-}
-
-// Auxiliary function used by divide(x, y). The call to divide
-// checks for the simple cases where x < y or y.size() == 1.
-//
-// If neither of those cases apply, this function is called. 
-// n and m are the size of x and y, respectively.
-//
-// The procedure mainly works by estimating the quotient digits,
-// correcting as necessary, and then subtracting the most recently
-// computed quotient digit (scaled to the apropriate power of 10)
-// from the current remainder.
-//
-// There is also a scaling step that reduces the expected number
-// of digit corrections.
-//
-// See the referenced paper for a full description of the algorithm.
-bigint::quot_rem longdiv(const bigvalue_t& x, const bigvalue_t& y,
-                      size_t n, size_t m) {
-    DEBUGF ('/', "longdiv(" << x << ", " << y << ", " <<
-                (int) n << ", " << (int) m << ")")
-    bigvalue_t d, dq, q(n, 0), r;
-    int f, qt;
-    int k;
-
-    f = 10 / (y.at(m - 1) + 1);
-    r = partial_prod(x, f);
-    d = partial_prod(y, f);
-    for (k = n - m; k >= 0; k--) {
-        qt = trialdigit(r, d, k, m);
-        dq = partial_prod(d, qt);
-        if (smaller(r, dq, k, m)) {
-            qt = qt - 1;
-            dq = partial_prod(d, qt);
-        }
-        DEBUGF ('/', "accessing q(" << (int) k << ")"
-                     << "and q has size " << q.size())
-        q.at(k) = qt;
-        r = difference(r, dq, k, m);
-    }
-    while (q.size() > 1 && q.back() == 0)
-        q.pop_back();
-    while (r.size() > 1 && r.back() == 0)
-        r.pop_back();
-    return make_pair(bigint(q), bigint(partial_quot(r,f)));
-}
-
-// Main division function. Checks for corner cases and then calls
-// longdiv(x, y, x.size(), y.size()) if necessary.
-bigint::quot_rem divide(const bigvalue_t& x, const bigvalue_t& y) {
-    DEBUGF ('/', "divide(" << x << ", " << y << ")")
-    int n, m, y1;
-    m = y.size();
-    if (m == 1) {
-        y1 = y.at(m - 1);
-        return make_pair(bigint(partial_quot(x, y1)),
-                         bigint(partial_rem(x, y1)));
-    } else {
-        n = x.size();
-        if (m > n)
-            return make_pair(bigint(0), x);
-        return longdiv(x, y, n, m);
+// Memo of the most recent call to divide(x, y).  A `/` followed
+// by a `%` on the same operands (or the reverse) reuses the pair
+// instead of running the long division a second time.
+static struct {
+    bool valid {false};
+    bigvalue_t dividend;
+    bigvalue_t divisor;
+    kernel::quot_rem result;
+} divide_memo;
+
+static const kernel::quot_rem& memo_divide(const bigvalue_t& x,
+                                           const bigvalue_t& y) {
+    if (divide_memo.valid and divide_memo.dividend == x
+                          and divide_memo.divisor == y) {
+        DEBUGF ('/', "divide(" << x << ", " << y << ") memo hit")
+        return divide_memo.result;
     }
+    divide_memo.result = kernel::divide(x, y);
+    divide_memo.dividend = x;
+    divide_memo.divisor = y;
+    divide_memo.valid = true;
+    return divide_memo.result;
 }
 
 // Overloading the division operator. Determines sign of quotient and
-// then calls divide(left, right).
+// then calls kernel::divide(left, right).
 bigint operator/ (const bigint& left, const bigint& right) {
     if (right == 0) throw ydc_exn ("ydc: divid by zero");
-    bigint result = divide (left.big_value, right.big_value).first;
+    bigint result = memo_divide (left.big_value, right.big_value).first;
     result.negative = left.negative ^ right.negative;
     return result;
 }
 
 // Overloading the modulus operator. Determines sign of quotient and
-// then calls divide(left, right).
+// then calls kernel::divide(left, right).
 bigint operator% (const bigint& left, const bigint& right) {
-    bigint result = divide (left.big_value, right.big_value).second;
+    bigint result = memo_divide (left.big_value,
+                                 right.big_value).second;
     result.negative = left.negative ^ right.negative;
     return result;
 }
 
+// Quotient and remainder of left / right from one call to divide,
+// with the same signs operator/ and operator% would give them.
+bigint::quot_rem divmod (const bigint& left, const bigint& right) {
+    if (right == 0) throw ydc_exn ("ydc: divid by zero");
+    const kernel::quot_rem& value = memo_divide (left.big_value,
+                                                 right.big_value);
+    bigint::quot_rem result (value.first, value.second);
+    result.first.negative = left.negative ^ right.negative;
+    result.second.negative = left.negative ^ right.negative;
+    return result;
+}
+
 // Overloading the equality operator. Checks sizes and signs, and if
 // necessary it steps through the digits to determine equality.
 bool operator== (const bigint& left, const bigint& right) {
@@ -507,12 +204,12 @@ bool operator< (const bigint& left, const bigint& right) {
         if (!right.negative)
             retval = true;
         else 
-            retval = do_bigless(right.big_value, left.big_value);
+            retval = kernel::less(right.big_value, left.big_value);
     } else {
         if (right.negative)
             retval = false;
         else 
-            retval = do_bigless(left.big_value, right.big_value);
+            retval = kernel::less(left.big_value, right.big_value);
     }
     DEBUGF ('l', "operator<(" << left << ", " << right 
                        << ") = " << retval) 
@@ -527,16 +224,12 @@ ostream& operator<< (ostream& out, const bigint& that) {
 }
 
 ostream& operator<< (ostream& out, const bigvalue_t& that) {
-    size_t i = 0;
-    for (auto rit  = that.crbegin();
-            rit != that.crend();
-            ++rit) {
-        out << (int) *rit;
-        i++;
-        if (i == LINE_LIMIT) {
+    string digits = kernel::to_decimal(that);
+    for (size_t i = 0; i < digits.size(); i += LINE_LIMIT) {
+        if (i > 0)
             out << "\\" << endl;
-            i = 0;
-        }
+        out.write(digits.data() + i,
+                  min<size_t>(LINE_LIMIT, digits.size() - i));
     }
     return out;
 }
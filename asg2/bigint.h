@@ -14,40 +14,31 @@
 using namespace std;
 
 #include "debug.h"
-using digit_t = unsigned char;
-using bigvalue_t = vector<digit_t>;
+#include "bigkernel.h"
+
+//
+// Digits are stored as limbs of limb_config (see limbtraits.h),
+// least significant first.  The allocator is the one place to plug
+// in a different memory strategy for them; by default their buffers
+// are recycled through limb_pool.
+//
+using digit_t = limb_config::limb_t;
+using digit_alloc = limb_allocator<digit_t>;
+using kernel = bigkernel<limb_config, digit_alloc>;
+using bigvalue_t = kernel::limbvec;
 
 //
 // Define class bigint
 //
 class bigint {
     friend ostream& operator<< (ostream&, const bigint&);
+  public:
+    using quot_rem = pair<bigint,bigint>;
   private:
     void init (const string&);
     long long_value {};
     bool negative;
     bigvalue_t big_value;
-    using quot_rem = pair<bigint,bigint>;
-    using unumber = unsigned long;
-    friend quot_rem divide (const bigint&, const bigint&);
-    friend void multiply_by_2 (unumber&);
-    friend void divide_by_2 (unumber&);
-    friend bigvalue_t do_bigadd (const bigvalue_t&, const bigvalue_t&);
-    friend bigvalue_t do_bigsub (const bigvalue_t&, const bigvalue_t&);
-    friend bigvalue_t do_bigmul (const bigvalue_t&, const bigvalue_t&);
-    friend bool do_bigless (const bigvalue_t&, const bigvalue_t&);
-    friend bigvalue_t partial_prod(const bigvalue_t&, size_t);
-    friend bigvalue_t partial_quot(const bigvalue_t&, size_t);
-    friend bigvalue_t partial_rem(const bigvalue_t&, size_t);
-    friend digit_t trialdigit(const bigvalue_t&, const bigvalue_t&,
-                              size_t, size_t);
-    friend bool smaller(const bigvalue_t&, const bigvalue_t&,
-                        size_t, size_t);
-    friend bigvalue_t difference(const bigvalue_t&, const bigvalue_t&,
-                                 size_t, size_t);
-    friend quot_rem longdiv(const bigvalue_t& x, const bigvalue_t& y,
-                            size_t n, size_t m);
-    friend quot_rem divide(const bigvalue_t& x, const bigvalue_t& y);
   public:
 
     //
@@ -83,6 +74,11 @@ class bigint {
     friend bigint operator/ (const bigint&, const bigint&);
     friend bigint operator% (const bigint&, const bigint&);
 
+    //
+    // Quotient and remainder from a single long division.
+    //
+    friend quot_rem divmod (const bigint&, const bigint&);
+
     //
     // Comparison operators.
     //
@@ -0,0 +1,72 @@
+// Author: Andrew Edwards
+// Email:  ancedwar@ucsc.edu
+// ID:     1253060
+// Date:   2015 Feb 02
+//
+// bigkernel.h
+
+#ifndef __BIGKERNEL_H__
+#define __BIGKERNEL_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "limbpool.h"
+#include "limbtraits.h"
+
+//
+// bigkernel -
+//    The magnitude arithmetic behind bigint, written once for any
+//    limb_traits.  Limbs are stored least significant first, and
+//    every result is trimmed of leading zero limbs.  The radix is a
+//    compile-time constant, so each configuration gets its own
+//    specialized loops.
+// add, sub, mul -
+//    Magnitude sum, difference and product.  sub requires that the
+//    left operand is not less than the right.
+// less -
+//    Magnitude comparison.
+// divide -
+//    Quotient and remainder.  The divisor must not be zero.
+// from_decimal, to_decimal -
+//    Conversion from and to an unsigned string of decimal digits.
+// The allocator holds the limbs of every limbvec, and by default
+// recycles their buffers through limb_pool.
+//
+
+template <typename traits,
+          typename allocator = limb_allocator<typename traits::limb_t>>
+class bigkernel {
+   public:
+      using limb_t = typename traits::limb_t;
+      using wide_t = typename traits::wide_t;
+      using limbvec = vector<limb_t, allocator>;
+      using quot_rem = pair<limbvec,limbvec>;
+      static limbvec add (const limbvec& left, const limbvec& right);
+      static limbvec sub (const limbvec& left, const limbvec& right);
+      static bool less (const limbvec& left, const limbvec& right);
+      static limbvec mul (const limbvec& left, const limbvec& right);
+      static quot_rem divide (const limbvec& x, const limbvec& y);
+      static limbvec from_decimal (const string& digits);
+      static string to_decimal (const limbvec& value);
+   private:
+      static void trim (limbvec& value);
+      static limbvec partial_prod (const limbvec& x, wide_t k,
+                                   wide_t carry = 0);
+      static limbvec partial_quot (const limbvec& x, wide_t k);
+      static limbvec partial_rem (const limbvec& x, wide_t k);
+      static wide_t trialdigit (const limbvec& r, const limbvec& d,
+                                size_t k, size_t m);
+      static bool smaller (const limbvec& r, const limbvec& dq,
+                           size_t k, size_t m);
+      static limbvec difference (const limbvec& r, const limbvec& dq,
+                                 size_t k, size_t m);
+      static quot_rem longdiv (const limbvec& x, const limbvec& y,
+                               size_t n, size_t m);
+};
+
+#include "bigkernel.tcc"
+#endif
+
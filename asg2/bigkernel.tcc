@@ -0,0 +1,428 @@
+// Author: Andrew Edwards
+// Email:  ancedwar@ucsc.edu
+// ID:     1253060
+// Date:   2015 Feb 02
+//
+// bigkernel.tcc
+
+#include <algorithm>
+
+#include "bigkernel.h"
+#include "debug.h"
+
+// Removes leading zero limbs, always leaving at least one limb.
+template <typename traits, typename allocator>
+void bigkernel<traits,allocator>::trim (limbvec& value) {
+    while (value.size() > 1 && value.back() == 0)
+        value.pop_back();
+}
+
+// Adds two limb vectors.
+// Same logic as addition by hand.
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::add (const limbvec& left,
+                                  const limbvec& right) {
+    const limbvec& longer = left.size() < right.size() ? right : left;
+    const limbvec& shorter = left.size() < right.size() ? left : right;
+    limbvec sum;
+    sum.reserve(longer.size() + 1);
+    wide_t carry(0);
+    wide_t limb_sum(0);
+    size_t i;
+    for (i = 0; i < shorter.size(); i++) {
+        // Compute limb sum. If it overflows the radix, take note
+        // with the carry bit and deduct the radix from the sum.
+        limb_sum = wide_t(longer[i]) + shorter[i] + carry;
+        if (limb_sum >= traits::RADIX) {
+            carry = 1;
+            limb_sum -= traits::RADIX;
+        } else {
+            carry = 0;
+        }
+        sum.push_back(limb_sum);
+    }
+    for (; i < longer.size(); i++) {
+        limb_sum = wide_t(longer[i]) + carry;
+        if (limb_sum >= traits::RADIX) {
+            carry = 1;
+            limb_sum -= traits::RADIX;
+        } else {
+            carry = 0;
+        }
+        sum.push_back(limb_sum);
+    }
+
+    // Last step: if the carry bit is set, we need to
+    // push back a 1 to be the new highest limb.
+    if (carry == 1)
+        sum.push_back(1);
+
+    return sum;
+}
+
+// Subtracts two limb vectors.
+// Same logic as subtraction by hand.
+// Precondition:  left >= right
+// Postcondition: result >= 0
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::sub (const limbvec& left,
+                                  const limbvec& right) {
+    limbvec diff;
+    diff.reserve(left.size());
+    wide_t borrow(0);
+    wide_t limb_diff(0);
+    size_t i;
+    for (i = 0; i < right.size(); i++) {
+        // Borrow from the next highest limb if the difference
+        // would be negative.
+        limb_diff = wide_t(left[i]) - right[i] - borrow;
+        if (limb_diff < 0) {
+            limb_diff += traits::RADIX;
+            borrow = 1;
+        } else {
+            borrow = 0;
+        }
+        diff.push_back(limb_diff);
+    }
+    for (; i < left.size(); i++) {
+        limb_diff = wide_t(left[i]) - borrow;
+        if (limb_diff < 0) {
+            limb_diff += traits::RADIX;
+            borrow = 1;
+        } else {
+            borrow = 0;
+        }
+        diff.push_back(limb_diff);
+    }
+    trim(diff);
+    return diff;
+}
+
+// Returns true if left < right.
+template <typename traits, typename allocator>
+bool bigkernel<traits,allocator>::less (const limbvec& left,
+                                        const limbvec& right) {
+    // if the vectors' sizes differ the answer is trivial
+    if (left.size() != right.size())
+        return left.size() < right.size();
+
+    // iterate from highest order limbs to find smaller input
+    auto lit = left.crbegin();
+    auto rit = right.crbegin();
+    for (; lit != left.crend(); lit++, rit++)
+        if (*lit != *rit)
+            return *lit < *rit;
+
+    // in this case they are equal
+    return false;
+}
+
+// Multiplies two limb vectors.
+// Same logic as long multiplication
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::mul (const limbvec& left,
+                                  const limbvec& right) {
+    limbvec product(left.size() + right.size(), 0);
+    wide_t c, d;
+    for (size_t i = 0; i < left.size(); i++) {
+        c = 0;
+        for (size_t j = 0; j < right.size(); j++) {
+            d = product[i+j] + wide_t(left[i]) * right[j] + c;
+            product[i+j] = d % traits::RADIX;
+            c = d / traits::RADIX;
+        }
+        product[i + right.size()] = c;
+    }
+    trim(product);
+    return product;
+}
+
+//
+// Long division algorithm.
+//
+// From P. Brinch Hansen,
+// Multiple-length division revisited: A tour of the minefield.
+
+// Partial product, quotient, and remainder assume that
+// x is a multiple length integer and k is a single limb
+// i.e. 0 <= k < RADIX.  The partial product also adds in
+// an initial carry, which is how decimal input is converted.
+
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::partial_prod (const limbvec& x, wide_t k,
+                                           wide_t carry) {
+    wide_t temp;
+    size_t size = x.size();
+    limbvec product(size + 1, 0);
+    for (size_t i = 0; i < size; i++) {
+        temp = x[i] * k + carry;
+        product[i] = temp % traits::RADIX;
+        carry = temp / traits::RADIX;
+    }
+    product[size] = carry;
+    trim(product);
+    DEBUGF ('/', "partial_prod(" << x << ", "
+                 << k << ") = " << product)
+    return product;
+}
+
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::partial_quot (const limbvec& x, wide_t k) {
+    wide_t temp, carry;
+    size_t size = x.size();
+    limbvec quotient(size, 0);
+    carry = 0;
+    for (size_t i = size - 1; i < size; i--) {
+        temp = x[i] + traits::RADIX * carry;
+        quotient[i] = temp / k;
+        carry = temp % k;
+    }
+    trim(quotient);
+    DEBUGF ('/', "partial_quot(" << x << ", "
+                 << k << ") = " << quotient)
+    return quotient;
+}
+
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::partial_rem (const limbvec& x, wide_t k) {
+    wide_t carry;
+    size_t size = x.size();
+    carry = 0;
+    for (size_t i = size - 1; i < size; i--) {
+        carry = (x[i] + traits::RADIX * carry) % k;
+    }
+    // Since k is a limb, the remainder must also be a limb
+    DEBUGF ('/', "partial_rem(" << x << ", "
+                 << k << ") = " << carry)
+    return limbvec(1, carry);
+}
+
+//
+// The computation of a quotient digit q_k breaks down into the
+// simpler prefix operations. The assignment
+//          q_t = trialdigit(r, d, k, m)
+// defines a trial digit, q_t = q_e, which is an inital estimate
+// of q_k. The operands of the trial digit function are prefixes
+// of the remainder r and the divisor d
+//      r[k + m - 2 ... k + m]    d[m - 1 ... m - 2]
+// where
+//          2 <= m <= k + m
+//
+
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::wide_t
+bigkernel<traits,allocator>::trialdigit (const limbvec& r,
+                                         const limbvec& d,
+                                         size_t k, size_t m) {
+    DEBUGF ('/', "trialdigit(" << r << ", " << d << ", " <<
+                 k << ", " << m << ")")
+    wide_t d2, r3;
+    size_t km;
+    km = k + m;
+    if (r.size() > km)
+        r3 = (r[km] * traits::RADIX + r[km - 1]) * traits::RADIX
+           + r[km - 2];
+    else if (r.size() > km - 1)
+        r3 = wide_t(r[km - 1]) * traits::RADIX + r[km - 2];
+    else if (r.size() > km - 2)
+        r3 = r[km - 2];
+    else
+        r3 = 0;
+
+    if (d.size() > m - 1)
+        d2 = wide_t(d[m - 1]) * traits::RADIX + d[m - 2];
+    else if (d.size() > m - 2)
+        d2 = d[m - 2];
+    else
+        d2 = 0;
+
+    wide_t qt = min(r3 / d2, wide_t(traits::RADIX - 1));
+    DEBUGF ('/', "trialdigit = " << qt)
+    return qt;
+}
+
+
+// Returns r[k ... k + m] < dq
+// (Note dq = dq[m ... 0])
+// Limbs past the end of either operand are leading zeroes.
+template <typename traits, typename allocator>
+bool bigkernel<traits,allocator>::smaller (const limbvec& r,
+                                           const limbvec& dq,
+                                           size_t k, size_t m) {
+    DEBUGF ('/', "smaller(" << r << ", " << dq << ", " <<
+                k << ", " << m << ")")
+    for (size_t i = m; ; i--) {
+        wide_t rdigit = i + k < r.size() ? r[i + k] : 0;
+        wide_t dqdigit = i < dq.size() ? dq[i] : 0;
+        if (rdigit != dqdigit or i == 0)
+            return rdigit < dqdigit;
+    }
+}
+
+// Returns r - dq * RADIX^k, corresponding to the long divison step
+// of subtracting from the high order limbs of the current remainder.
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::difference (const limbvec& r,
+                                         const limbvec& dq,
+                                         size_t k, size_t m) {
+    (void) m; // SUPPRESS: warning: unused parameter 'm' with NDEBUG
+    // Do the multiplication locally, since it is trivial
+    limbvec dq_shifted(k, 0);
+    dq_shifted.insert(dq_shifted.end(), dq.cbegin(), dq.cend());
+    limbvec diff = sub(r, dq_shifted);
+
+    DEBUGF ('/', "difference(" << r << ", " << dq << ", " <<
+                k << ", " << m << ")" << " = " << diff)
+
+    return diff;
+}
+
+// Auxiliary function used by divide(x, y). The call to divide
+// checks for the simple cases where x < y or y.size() == 1.
+//
+// If neither of those cases apply, this function is called.
+// n and m are the size of x and y, respectively.
+//
+// The procedure mainly works by estimating the quotient digits,
+// correcting as necessary, and then subtracting the most recently
+// computed quotient digit (scaled to the apropriate power of the
+// radix) from the current remainder.
+//
+// There is also a scaling step that reduces the expected number
+// of digit corrections.
+//
+// See the referenced paper for a full description of the algorithm.
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::quot_rem
+bigkernel<traits,allocator>::longdiv (const limbvec& x,
+                                      const limbvec& y,
+                                      size_t n, size_t m) {
+    DEBUGF ('/', "longdiv(" << x << ", " << y << ", " <<
+                n << ", " << m << ")")
+    limbvec d, dq, q(n, 0), r;
+    wide_t f, qt;
+
+    f = traits::RADIX / (y[m - 1] + 1);
+    r = partial_prod(x, f);
+    d = partial_prod(y, f);
+    for (size_t k = n - m; k <= n - m; k--) {
+        qt = trialdigit(r, d, k, m);
+        dq = partial_prod(d, qt);
+        if (smaller(r, dq, k, m)) {
+            qt = qt - 1;
+            dq = partial_prod(d, qt);
+        }
+        q[k] = qt;
+        r = difference(r, dq, k, m);
+    }
+    trim(q);
+    trim(r);
+    return make_pair(q, partial_quot(r, f));
+}
+
+// Main division function. Checks for corner cases and then calls
+// longdiv(x, y, x.size(), y.size()) if necessary.
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::quot_rem
+bigkernel<traits,allocator>::divide (const limbvec& x,
+                                     const limbvec& y) {
+    DEBUGF ('/', "divide(" << x << ", " << y << ")")
+    size_t n, m;
+    m = y.size();
+    if (m == 1) {
+        wide_t y1 = y[0];
+        return make_pair(partial_quot(x, y1), partial_rem(x, y1));
+    } else {
+        n = x.size();
+        if (m > n)
+            return make_pair(limbvec(1, 0), x);
+        return longdiv(x, y, n, m);
+    }
+}
+
+// Converts a string of decimal digits.  When each limb holds
+// exactly one chunk of decimal digits the chunks are copied
+// straight in, least significant first.  Otherwise each chunk is
+// folded in with a multiply by DECIMAL_RADIX and an add.
+template <typename traits, typename allocator>
+typename bigkernel<traits,allocator>::limbvec
+bigkernel<traits,allocator>::from_decimal (const string& digits) {
+    const size_t chunk = traits::DECIMAL_DIGITS;
+    limbvec value;
+    if (traits::RADIX == traits::DECIMAL_RADIX) {
+        value.reserve(digits.size() / chunk + 1);
+        for (size_t end = digits.size(); end > 0; ) {
+            size_t start = end > chunk ? end - chunk : 0;
+            wide_t limb = 0;
+            for (size_t i = start; i < end; i++)
+                limb = limb * 10 + digits[i] - '0';
+            value.push_back(limb);
+            end = start;
+        }
+        if (value.empty())
+            value.push_back(0);
+    } else {
+        value.push_back(0);
+        size_t start = 0;
+        size_t end = digits.size() % chunk;
+        if (end == 0) end = chunk;
+        for (; start < digits.size(); start = end, end += chunk) {
+            wide_t limb = 0;
+            for (size_t i = start; i < end; i++)
+                limb = limb * 10 + digits[i] - '0';
+            value = partial_prod(value, traits::DECIMAL_RADIX, limb);
+        }
+    }
+    trim(value);
+    return value;
+}
+
+// Converts to a string of decimal digits, the inverse of
+// from_decimal.  Every chunk but the most significant one is
+// padded with zeroes to DECIMAL_DIGITS.
+template <typename traits, typename allocator>
+string bigkernel<traits,allocator>::to_decimal (const limbvec& value) {
+    const size_t chunk = traits::DECIMAL_DIGITS;
+    limbvec chunks;
+    if (traits::RADIX == traits::DECIMAL_RADIX) {
+        chunks = value;
+    } else {
+        // Short division by DECIMAL_RADIX, done inline rather than
+        // with partial_quot so that tracing it does not recurse.
+        limbvec rest = value;
+        do {
+            wide_t carry = 0;
+            for (size_t i = rest.size() - 1; i < rest.size(); i--) {
+                wide_t temp = rest[i] + traits::RADIX * carry;
+                rest[i] = temp / traits::DECIMAL_RADIX;
+                carry = temp % traits::DECIMAL_RADIX;
+            }
+            trim(rest);
+            chunks.push_back(carry);
+        } while (rest.size() > 1 or rest[0] != 0);
+    }
+    string digits;
+    digits.reserve(chunks.size() * chunk);
+    for (auto rit = chunks.crbegin(); rit != chunks.crend(); ++rit) {
+        char buffer[chunk];
+        wide_t limb = *rit;
+        for (size_t i = chunk; i > 0; i--) {
+            buffer[i - 1] = '0' + limb % 10;
+            limb /= 10;
+        }
+        size_t skip = 0;
+        if (digits.empty())
+            while (skip < chunk - 1 and buffer[skip] == '0')
+                ++skip;
+        digits.append(buffer + skip, chunk - skip);
+    }
+    return digits;
+}
+
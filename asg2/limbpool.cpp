@@ -0,0 +1,77 @@
+// Author: Andrew Edwards
+// Email:  ancedwar@ucsc.edu
+// ID:     1253060
+// Date:   2015 Jan 30
+//
+// limbpool.cpp
+
+#include <new>
+using namespace std;
+
+#include "limbpool.h"
+
+limb_pool::free_block* limb_pool::free_lists[MAX_CLASS + 1] {};
+size_t limb_pool::heap_allocs_ {0};
+size_t limb_pool::reuses_ {0};
+bool limb_pool::drained_ {false};
+
+// The pool state above is plain data and is never destroyed, so
+// bigints in other static objects may still release their digits
+// after this runs.
+static struct limb_pool_drainer {
+   ~limb_pool_drainer() { limb_pool::drain(); }
+} drainer;
+
+// Smallest class whose block holds the given number of bytes, or
+// MAX_CLASS + 1 if the request is too big to be pooled.
+size_t limb_pool::size_class (size_t bytes) {
+   size_t sclass = MIN_CLASS;
+   while (sclass <= MAX_CLASS and (size_t (1) << sclass) < bytes)
+      ++sclass;
+   return sclass;
+}
+
+void* limb_pool::allocate (size_t bytes) {
+   size_t sclass = size_class (bytes);
+   if (sclass > MAX_CLASS) {
+      ++heap_allocs_;
+      return ::operator new (bytes);
+   }
+   free_block* block = free_lists[sclass];
+   if (block != nullptr) {
+      free_lists[sclass] = block->next;
+      ++reuses_;
+      return block;
+   }
+   ++heap_allocs_;
+   return ::operator new (size_t (1) << sclass);
+}
+
+void limb_pool::release (void* block, size_t bytes) {
+   if (block == nullptr) return;
+   size_t sclass = size_class (bytes);
+   if (sclass > MAX_CLASS or drained_) {
+      ::operator delete (block);
+      return;
+   }
+   free_block* freed = static_cast<free_block*> (block);
+   freed->next = free_lists[sclass];
+   free_lists[sclass] = freed;
+}
+
+void limb_pool::drain() {
+   for (size_t sclass = MIN_CLASS; sclass <= MAX_CLASS; ++sclass) {
+      while (free_lists[sclass] != nullptr) {
+         free_block* block = free_lists[sclass];
+         free_lists[sclass] = block->next;
+         ::operator delete (block);
+      }
+   }
+   drained_ = true;
+}
+
+void limb_pool::report (ostream& out) {
+   out << "limb_pool: heap allocations = " << heap_allocs_
+       << ", heap allocations avoided = " << reuses_ << endl;
+}
+
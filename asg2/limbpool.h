@@ -0,0 +1,86 @@
+// Author: Andrew Edwards
+// Email:  ancedwar@ucsc.edu
+// ID:     1253060
+// Date:   2015 Jan 30
+//
+// limbpool.h
+
+#ifndef __LIMBPOOL_H__
+#define __LIMBPOOL_H__
+
+#include <cstddef>
+#include <iostream>
+using namespace std;
+
+//
+// limb_pool -
+//    A static class which recycles the digit buffers of bigint
+//    temporaries.  Requests are rounded up to a power of two and
+//    released blocks are kept on a free list for their size class,
+//    so the next request of that class does not go to the heap.
+//    Blocks larger than the biggest class bypass the pool.
+// allocate -
+//    Returns a block of at least the given number of bytes.
+// release -
+//    Returns a block to its free list.  The size must be the one
+//    that was passed to allocate.
+// drain -
+//    Frees every pooled block.  Called automatically at exit, after
+//    which released blocks go straight back to the heap.
+// report -
+//    Prints the allocation counters.
+//
+
+class limb_pool {
+   private:
+      struct free_block { free_block* next; };
+      static constexpr size_t MIN_CLASS = 4;  // 16 bytes
+      static constexpr size_t MAX_CLASS = 16; // 64 KiB
+      static free_block* free_lists[MAX_CLASS + 1];
+      static size_t heap_allocs_;
+      static size_t reuses_;
+      static bool drained_;
+      static size_t size_class (size_t bytes);
+   public:
+      static void* allocate (size_t bytes);
+      static void release (void* block, size_t bytes);
+      static void drain();
+      static size_t heap_allocs() {return heap_allocs_; }
+      static size_t reuses() {return reuses_; }
+      static void report (ostream& out);
+};
+
+//
+// limb_allocator -
+//    A stateless allocator that forwards to limb_pool, for use as
+//    the allocator of a digit vector.
+//
+
+template <typename value_t>
+struct limb_allocator {
+   using value_type = value_t;
+   limb_allocator() = default;
+   template <typename other_t>
+   limb_allocator (const limb_allocator<other_t>&) {}
+   value_t* allocate (size_t count) {
+      return static_cast<value_t*> (
+             limb_pool::allocate (count * sizeof (value_t)));
+   }
+   void deallocate (value_t* block, size_t count) {
+      limb_pool::release (block, count * sizeof (value_t));
+   }
+};
+
+template <typename left_t, typename right_t>
+inline bool operator== (const limb_allocator<left_t>&,
+                        const limb_allocator<right_t>&) {
+   return true;
+}
+template <typename left_t, typename right_t>
+inline bool operator!= (const limb_allocator<left_t>&,
+                        const limb_allocator<right_t>&) {
+   return false;
+}
+
+#endif
+
@@ -0,0 +1,95 @@
+// Author: Andrew Edwards
+// Email:  ancedwar@ucsc.edu
+// ID:     1253060
+// Date:   2015 Feb 02
+//
+// limbtraits.h
+
+#ifndef __LIMBTRAITS_H__
+#define __LIMBTRAITS_H__
+
+#include <cstdint>
+using namespace std;
+
+//
+// power -
+//    base raised to exponent, evaluated at compile time.
+// log_floor -
+//    Largest k such that base^k <= limit.
+//
+
+constexpr long long power (long long base, int exponent) {
+   return exponent == 0 ? 1 : base * power (base, exponent - 1);
+}
+
+constexpr int log_floor (long long base, long long limit) {
+   return limit < base ? 0 : 1 + log_floor (base, limit / base);
+}
+
+//
+// POW10 -
+//    Powers of ten that fit in a long long, used to convert between
+//    limbs and decimal digit strings.
+//
+
+constexpr long long POW10[] = {
+   power (10,  0), power (10,  1), power (10,  2), power (10,  3),
+   power (10,  4), power (10,  5), power (10,  6), power (10,  7),
+   power (10,  8), power (10,  9), power (10, 10), power (10, 11),
+   power (10, 12), power (10, 13), power (10, 14), power (10, 15),
+   power (10, 16), power (10, 17), power (10, 18),
+};
+
+//
+// limb_traits -
+//    Describes one limb representation for bigkernel.
+// limb_t -
+//    The type each limb is stored in.
+// wide_t -
+//    A signed type wide enough to hold RADIX^3, which is what the
+//    trial quotient digit of long division needs.
+// RADIX -
+//    The base of each limb.
+// DECIMAL_DIGITS -
+//    How many decimal digits are read or printed per chunk.
+// DECIMAL_RADIX -
+//    10^DECIMAL_DIGITS.  When it equals RADIX, each limb holds
+//    exactly one chunk and I/O needs no base conversion.
+//
+
+template <typename limb_type, typename wide_type, long long radix>
+struct limb_traits {
+   using limb_t = limb_type;
+   using wide_t = wide_type;
+   static constexpr wide_t RADIX = radix;
+   static constexpr int DECIMAL_DIGITS = log_floor (10, radix);
+   static constexpr wide_t DECIMAL_RADIX = POW10[DECIMAL_DIGITS];
+};
+
+//
+// decimal_limbs -
+//    One decimal digit per byte.  Reading and printing are a simple
+//    copy, which suits I/O-heavy use.
+// binary_limbs -
+//    Sixteen bits per limb.  Arithmetic touches a quarter as many
+//    limbs, which suits compute-heavy use, at the price of a base
+//    conversion on input and output.
+//
+
+using decimal_limbs = limb_traits<unsigned char, int, 10>;
+using binary_limbs = limb_traits<uint16_t, long long, 1LL << 16>;
+
+//
+// limb_config -
+//    The representation this build uses.  Compile with
+//    -DBINARY_LIMBS to select binary_limbs.
+//
+
+#ifdef BINARY_LIMBS
+using limb_config = binary_limbs;
+#else
+using limb_config = decimal_limbs;
+#endif
+
+#endif
+
@@ -18,6 +18,7 @@ using namespace std;
 #include "bigint.h"
 #include "debug.h"
 #include "iterstack.h"
+#include "limbpool.h"
 #include "scanner.h"
 #include "util.h"
 
@@ -46,6 +47,21 @@ void do_arith (bigint_stack& stack, const char oper) {
    stack.push (result);
 }
 
+void do_divmod (bigint_stack& stack, const char) {
+   if (stack.size() < 2) throw ydc_exn ("stack empty");
+   bigint right = stack.top();
+   stack.pop();
+   DEBUGF ('d', "right = " << right);
+   bigint left = stack.top();
+   stack.pop();
+   DEBUGF ('d', "left = " << left);
+   bigint::quot_rem result = divmod (left, right);
+   DEBUGF ('d', "quotient = " << result.first
+                << ", remainder = " << result.second);
+   stack.push (result.first);
+   stack.push (result.second);
+}
+
 void do_clear (bigint_stack& stack, const char) {
    DEBUGF ('d', "");
    stack.clear();
@@ -84,6 +100,7 @@ fn_map do_functions = {
    {"/", do_arith},
    {"%", do_arith},
    {"^", do_arith},
+   {"~", do_divmod},
    {"Y", do_debug},
    {"c", do_clear},
    {"d", do_dup},
@@ -156,6 +173,7 @@ int main (int argc, char** argv) {
    }catch (ydc_quit&) {
       // Intentionally left empty.
    }
+   DEBUGS ('P', limb_pool::report (cerr));
    return sys_info::status();
 }
 